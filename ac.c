@@ -0,0 +1,143 @@
+/*****************************************************************************
+ * Forbidden substring automaton for pgen
+ *
+ * A list of forbidden substrings is compiled into a deterministic
+ * Aho-Corasick automaton whose transition table only has columns for the
+ * symbols the generator can actually produce, so the table stays small and
+ * a generated character costs a single table load. Matching ignores case.
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "ac.h"
+
+/**
+ * Compiles the newline separated substrings in list into dfa. alphabet[c] is
+ * nonzero for every byte c the generator can produce; substrings containing
+ * any other byte can never occur and are left out. Returns 1 on success, on
+ * failure an error is printed to stderr and 0 is returned.
+ */
+int
+ac_compile(struct ac_dfa *dfa, const char *list, const unsigned char alphabet[256])
+{
+    unsigned char folded[256] = { 0 };
+    size_t      max_states = 1;
+    size_t      ncols      = 0;
+    size_t      other;
+    uint32_t    *fail      = NULL;
+    uint32_t    *queue     = NULL;
+    const char  *p;
+
+    memset(dfa, 0, sizeof(struct ac_dfa));
+
+    // one column per distinct folded symbol, plus one for anything else
+    for (int c = 0; c < 256; ++c)
+        if (alphabet[c])
+            folded[tolower(c)] = 1;
+    for (int c = 0; c < 256; ++c)
+        if (folded[c])
+            dfa->col[c] = (unsigned char) ncols++;
+    other = ncols++;
+    for (int c = 0; c < 256; ++c)
+        dfa->col[c] = folded[tolower(c)] ? dfa->col[tolower(c)]
+                                         : (unsigned char) other;
+    dfa->ncols = ncols;
+
+    for (p = list; *p; ++p)
+        max_states += *p != '\n';
+    if (max_states > UINT32_MAX) {
+        fprintf(stderr, "E: forbidden substring list too long\n");
+        return 0;
+    }
+
+    dfa->next  = calloc(max_states * ncols, sizeof(uint32_t));
+    dfa->match = calloc(max_states, 1);
+    fail       = malloc(max_states * sizeof(uint32_t));
+    queue      = malloc(max_states * sizeof(uint32_t));
+    if (!dfa->next || !dfa->match || !fail || !queue) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        goto fail;
+    }
+    dfa->nstates = 1;
+
+    // build the trie, state 0 is the root and is never a child
+    for (p = list; *p; ) {
+        const char  *eol = strchr(p, '\n');
+        size_t      raw  = eol ? (size_t) (eol - p) : strlen(p);
+        size_t      len  = raw;
+        uint32_t    s    = 0;
+        size_t      i;
+
+        if (len && p[len - 1] == '\r')
+            --len;
+        for (i = 0; i < len; ++i)
+            if (dfa->col[(unsigned char) p[i]] == other)
+                break;
+
+        if (len && i == len) {
+            for (i = 0; i < len; ++i) {
+                uint32_t *t = &AC_STEP(dfa, s, p[i]);
+
+                if (!*t)
+                    *t = (uint32_t) dfa->nstates++;
+                s = *t;
+            }
+            dfa->match[s] = 1;
+            ++dfa->npatterns;
+        }
+
+        p += eol ? raw + 1 : raw;
+    }
+
+    // breadth first, fill in missing transitions by following failure links
+    {
+        size_t qhead = 0;
+        size_t qtail = 0;
+
+        for (size_t c = 0; c < ncols; ++c) {
+            uint32_t t = dfa->next[c];
+
+            if (t) {
+                fail[t] = 0;
+                queue[qtail++] = t;
+            }
+        }
+        while (qhead < qtail) {
+            uint32_t s = queue[qhead++];
+
+            dfa->match[s] |= dfa->match[fail[s]];
+            for (size_t c = 0; c < ncols; ++c) {
+                uint32_t *t = &dfa->next[s * ncols + c];
+                uint32_t f  = dfa->next[fail[s] * ncols + c];
+
+                if (*t) {
+                    fail[*t] = f;
+                    queue[qtail++] = *t;
+                } else {
+                    *t = f;
+                }
+            }
+        }
+    }
+
+    free(fail);
+    free(queue);
+    return 1;
+
+fail:
+    free(fail);
+    free(queue);
+    ac_free(dfa);
+    return 0;
+}
+
+void
+ac_free(struct ac_dfa *dfa)
+{
+    free(dfa->next);
+    free(dfa->match);
+    memset(dfa, 0, sizeof(struct ac_dfa));
+}
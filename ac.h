@@ -0,0 +1,32 @@
+#ifndef AC_H
+#define AC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Aho-Corasick automaton compiled into a DFA. Rows are states, columns are
+ * the symbols that can be generated, folded to lower case; column ncols - 1
+ * stands for any other byte. match[s] is set if reaching state s means a
+ * forbidden substring has just been completed.
+ */
+struct ac_dfa {
+    uint32_t        *next;          // nstates * ncols transitions
+    unsigned char   *match;
+    size_t          nstates;
+    size_t          ncols;
+    size_t          npatterns;      // patterns that can occur at all
+    unsigned char   col[256];       // byte to column
+};
+
+int ac_compile(struct ac_dfa *dfa, const char *list,
+               const unsigned char alphabet[256]);
+void ac_free(struct ac_dfa *dfa);
+
+/*
+ * Advances the automaton by one byte
+ */
+#define AC_STEP(dfa, state, c) \
+    ((dfa)->next[(size_t) (state) * (dfa)->ncols + (dfa)->col[(unsigned char) (c)]])
+
+#endif  /* AC_H */
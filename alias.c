@@ -0,0 +1,212 @@
+/*****************************************************************************
+ * Weighted symbol selection for pgen
+ *
+ * Symbol weights are compiled once into an alias table (Vose's method), after
+ * which drawing a symbol takes two pseudorandom values and no search: one
+ * picks a column uniformly, the other decides between the column's own
+ * symbol and its alias.
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "alias.h"
+#include "charset.h"
+
+static const struct {
+    const char      *name;
+    charset_opt_t   opt;
+} weight_classes[] = {
+    { "lower", LOWER },
+    { "upper", UPPER },
+    { "digit", DIGIT },
+    { "punct", PUNCT },
+};
+
+/**
+ * Applies a weight specification to weights, which holds one entry for each
+ * symbol in symtab. spec is a list of key=weight items separated by commas
+ * or newlines, where key is either a single symbol or one of the class names
+ * lower, upper, digit or punct. Weights are relative and must be positive.
+ * e.g. "punct=0.25,_=1" makes punctuation other than '_' four times rarer.
+ * A comma directly followed by '=' is a key, so ",=0.1" weights the comma.
+ * Returns 1 on success, on failure an error is printed to stderr and 0 is
+ * returned.
+ */
+int
+weights_parse(const char *spec, const char *symtab, double *weights)
+{
+    const char *p = spec;
+
+    while (*p) {
+        const char      *item = p;
+        charset_opt_t   opt   = 0;
+        int             sym   = -1;
+        char            *end;
+        double          w;
+
+        // skip separators and blank lines, unless a comma is the key
+        if ((*p == ',' && p[1] != '=') || *p == '\n' || *p == '\r') {
+            ++p;
+            continue;
+        }
+
+        if (p[1] == '=') {
+            sym = (unsigned char) *p;
+            p += 2;
+        } else {
+            for (size_t i = 0; i < sizeof weight_classes / sizeof *weight_classes; ++i) {
+                size_t n = strlen(weight_classes[i].name);
+
+                if (!strncmp(p, weight_classes[i].name, n) && p[n] == '=') {
+                    opt = weight_classes[i].opt;
+                    p += n + 1;
+                    break;
+                }
+            }
+            if (!opt) {
+                fprintf(stderr, "E: bad weight key near '%.16s'\n", item);
+                return 0;
+            }
+        }
+
+        w = strtod(p, &end);
+        if (end == p || !(w > 0) || !isfinite(w) ||
+            (*end && *end != ',' && *end != '\n' && *end != '\r'))
+        {
+            fprintf(stderr, "E: bad weight near '%.16s'\n", item);
+            return 0;
+        }
+        p = end;
+
+        if (sym != -1) {
+            const char *s = strchr(symtab, sym);
+
+            if (!sym || !s) {
+                fprintf(stderr, "E: weighted symbol '%c' is not in symbol table\n",
+                        sym);
+                return 0;
+            }
+            weights[s - symtab] = w;
+        } else {
+            for (size_t i = 0; symtab[i]; ++i)
+                if (in_charset(opt, (unsigned char) symtab[i]))
+                    weights[i] = w;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Builds an alias table for n symbols with the given relative weights.
+ * Returns 1 on success, on failure an error is printed to stderr and 0 is
+ * returned. tab->prob must be freed by the caller.
+ */
+int
+alias_build(struct alias_table *tab, const double *weights, size_t n)
+{
+    double  *p;
+    size_t  *small;
+    size_t  *large;
+    size_t  nsmall = 0;
+    size_t  nlarge = 0;
+    double  total  = 0;
+    int     ret    = 0;
+
+    if (n < 1 || n > UCHAR_MAX + 1) {
+        fprintf(stderr, "E: invalid table length '%zu'\n", n);
+        return 0;
+    }
+
+    tab->len   = n;
+    tab->prob  = malloc(n * (sizeof(uint32_t) + 1));
+    p          = malloc(n * sizeof(double));
+    small      = malloc(n * sizeof(size_t));
+    large      = malloc(n * sizeof(size_t));
+    if (!tab->prob || !p || !small || !large) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        free(tab->prob);
+        tab->prob = NULL;
+        goto done;
+    }
+    tab->alias = (unsigned char *) (tab->prob + n);
+
+    for (size_t i = 0; i < n; ++i)
+        total += weights[i];
+
+    tab->entropy = 0;
+    for (size_t i = 0; i < n; ++i) {
+        double q = weights[i] / total;
+
+        if (q > 0)
+            tab->entropy -= q * log2(q);
+
+        // scale so the average column holds exactly 1
+        p[i] = q * n;
+        if (p[i] < 1)
+            small[nsmall++] = i;
+        else
+            large[nlarge++] = i;
+    }
+
+    // pair each underfull column with an overfull one which tops it up
+    while (nsmall && nlarge) {
+        size_t l = small[--nsmall];
+        size_t g = large[nlarge - 1];
+
+        tab->prob[l]  = (uint32_t) (p[l] * 4294967296.0);
+        tab->alias[l] = (unsigned char) g;
+
+        p[g] = (p[g] + p[l]) - 1;
+        if (p[g] < 1) {
+            --nlarge;
+            small[nsmall++] = g;
+        }
+    }
+
+    // what remains is full up to rounding error, such columns alias themselves
+    while (nlarge) {
+        size_t g = large[--nlarge];
+
+        tab->prob[g]  = UINT32_MAX;
+        tab->alias[g] = (unsigned char) g;
+    }
+    while (nsmall) {
+        size_t l = small[--nsmall];
+
+        tab->prob[l]  = UINT32_MAX;
+        tab->alias[l] = (unsigned char) l;
+    }
+    ret = 1;
+
+done:
+    free(p);
+    free(small);
+    free(large);
+    return ret;
+}
+
+/**
+ * Draws a symbol index according to the table's weights. Returns 1 on
+ * success, 0 on failure.
+ */
+int
+alias_sample(const struct alias_table *tab, struct entropy *src, size_t *out)
+{
+    uint32_t col;
+    uint32_t coin;
+
+    if (!entropy_uniform(src, (uint32_t) tab->len, &col) ||
+        !entropy_u32(src, &coin))
+    {
+        return 0;
+    }
+
+    *out = (coin < tab->prob[col]) ? col : tab->alias[col];
+
+    return 1;
+}
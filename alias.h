@@ -0,0 +1,26 @@
+#ifndef ALIAS_H
+#define ALIAS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "entropy.h"
+
+/*
+ * Walker/Vose alias table over the symbols of a symbol table. Column i is
+ * kept with probability prob[i] / 2^32, otherwise alias[i] is used instead.
+ * prob and alias share one allocation starting at prob.
+ */
+struct alias_table {
+    size_t          len;
+    uint32_t        *prob;
+    unsigned char   *alias;
+    double          entropy;        // Shannon entropy in bits per symbol
+};
+
+int weights_parse(const char *spec, const char *symtab, double *weights);
+int alias_build(struct alias_table *tab, const double *weights, size_t n);
+int alias_sample(const struct alias_table *tab, struct entropy *src,
+                 size_t *out);
+
+#endif  /* ALIAS_H */
@@ -0,0 +1,233 @@
+/*****************************************************************************
+ * Asynchronous password reserve for pgen
+ *
+ * The lock is only ever held to move slot indices and copy passwords out of
+ * the reserve, the refill thread generates into a slot outside of it. Only
+ * the refill thread touches the pseudorandom device.
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "async.h"
+
+/*
+ * Makes the notification descriptor readable. Called with the lock held.
+ */
+static void
+notify(struct pgen_async *as)
+{
+    char    c = 0;
+    ssize_t n;
+
+    // a full pipe already reads as ready, nothing is lost by ignoring EAGAIN
+    n = write(as->notify[1], &c, 1);
+    (void) n;
+    as->want = 0;
+}
+
+static void *
+refill_thread(void *arg)
+{
+    struct pgen_async   *as = arg;
+    char                *tmp;
+
+    if (!(tmp = malloc(as->slot_size))) {
+        pthread_mutex_lock(&as->lock);
+        as->failed = 1;
+        notify(as);
+        pthread_mutex_unlock(&as->lock);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&as->lock);
+    while (!as->stop) {
+        if (as->count == as->cap) {
+            pthread_cond_wait(&as->refill, &as->lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&as->lock);
+        if (!gen_run(as->prog, &as->src, tmp)) {
+            pthread_mutex_lock(&as->lock);
+            as->failed = 1;
+            notify(as);
+            break;
+        }
+        pthread_mutex_lock(&as->lock);
+
+        memcpy(as->reserve + ((as->head + as->count) % as->cap) * as->slot_size,
+               tmp, as->slot_size);
+        ++as->count;
+        if (as->want && as->count >= as->want)
+            notify(as);
+    }
+    pthread_mutex_unlock(&as->lock);
+
+    memset(tmp, 0, as->slot_size);
+    free(tmp);
+    return NULL;
+}
+
+/**
+ * Sets up a reserve of up to reserve passwords generated by prog, which must
+ * outlive as, and starts filling it in the background. Returns 1 on success,
+ * on failure an error is printed to stderr and 0 is returned.
+ */
+int
+pgen_async_init(struct pgen_async *as, const struct gen_prog *prog,
+                size_t reserve)
+{
+    memset(as, 0, sizeof(struct pgen_async));
+    as->prog      = prog;
+    as->slot_size = prog->len + 1;
+    as->cap       = reserve ? reserve : 1;
+    as->notify[0] = as->notify[1] = -1;
+
+    if (!(as->reserve = malloc(as->cap * as->slot_size))) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        return 0;
+    }
+    if (pipe(as->notify) == -1) {
+        perror("pipe");
+        goto fail_pipe;
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (fcntl(as->notify[i], F_SETFL, O_NONBLOCK) == -1 ||
+            fcntl(as->notify[i], F_SETFD, FD_CLOEXEC) == -1)
+        {
+            perror("fcntl");
+            goto fail_src;
+        }
+    }
+    if (!entropy_open(&as->src, ENTROPY_PATH))
+        goto fail_src;
+
+    pthread_mutex_init(&as->lock, NULL);
+    pthread_cond_init(&as->refill, NULL);
+    if (pthread_create(&as->thread, NULL, refill_thread, as)) {
+        fprintf(stderr, "E: failed to create refill thread\n");
+        pthread_cond_destroy(&as->refill);
+        pthread_mutex_destroy(&as->lock);
+        entropy_close(&as->src);
+        goto fail_src;
+    }
+
+    return 1;
+
+fail_src:
+    close(as->notify[0]);
+    close(as->notify[1]);
+fail_pipe:
+    free(as->reserve);
+    return 0;
+}
+
+/**
+ * Stops the refill thread and wipes the reserve
+ */
+void
+pgen_async_destroy(struct pgen_async *as)
+{
+    pthread_mutex_lock(&as->lock);
+    as->stop = 1;
+    pthread_cond_signal(&as->refill);
+    pthread_mutex_unlock(&as->lock);
+    pthread_join(as->thread, NULL);
+
+    pthread_cond_destroy(&as->refill);
+    pthread_mutex_destroy(&as->lock);
+    entropy_close(&as->src);
+    close(as->notify[0]);
+    close(as->notify[1]);
+    memset(as->reserve, 0, as->cap * as->slot_size);
+    free(as->reserve);
+    memset(as, 0, sizeof(struct pgen_async));
+}
+
+/**
+ * Returns a descriptor that becomes readable once a requested batch is
+ * ready, or generation has failed
+ */
+int
+pgen_async_fd(const struct pgen_async *as)
+{
+    return as->notify[0];
+}
+
+/**
+ * Requests a batch of n passwords, at most the reserve size. The descriptor
+ * becomes readable as soon as n passwords can be taken, which may be at once.
+ * Returns 1 on success, 0 if n is out of range or generation has failed.
+ */
+int
+pgen_async_request(struct pgen_async *as, size_t n)
+{
+    int ret = 1;
+
+    if (n < 1 || n > as->cap)
+        return 0;
+
+    pthread_mutex_lock(&as->lock);
+    if (as->failed) {
+        ret = 0;
+    } else if (as->count >= n) {
+        notify(as);
+    } else {
+        as->want = n;
+        pthread_cond_signal(&as->refill);
+    }
+    pthread_mutex_unlock(&as->lock);
+
+    return ret;
+}
+
+/**
+ * Copies up to n ready passwords to out, each prog->len + 1 bytes including
+ * its terminator, and clears the descriptor's readiness. Never waits for
+ * passwords to be generated. Returns the number of passwords copied.
+ */
+size_t
+pgen_async_take(struct pgen_async *as, char *out, size_t n)
+{
+    char    drain[64];
+    size_t  taken = 0;
+
+    while (read(as->notify[0], drain, sizeof drain) > 0)
+        ;
+
+    pthread_mutex_lock(&as->lock);
+    while (taken < n && as->count) {
+        char *slot = as->reserve + as->head * as->slot_size;
+
+        memcpy(out + taken * as->slot_size, slot, as->slot_size);
+        memset(slot, 0, as->slot_size);
+        as->head = (as->head + 1) % as->cap;
+        --as->count;
+        ++taken;
+    }
+    pthread_cond_signal(&as->refill);
+    pthread_mutex_unlock(&as->lock);
+
+    return taken;
+}
+
+/**
+ * Returns nonzero if the refill thread has stopped on an error
+ */
+int
+pgen_async_failed(struct pgen_async *as)
+{
+    int failed;
+
+    pthread_mutex_lock(&as->lock);
+    failed = as->failed;
+    pthread_mutex_unlock(&as->lock);
+
+    return failed;
+}
@@ -0,0 +1,42 @@
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "entropy.h"
+#include "gen.h"
+
+/*
+ * Non-blocking password source for event loops. A background thread keeps a
+ * reserve of passwords generated by prog topped up. A caller requests a batch
+ * with pgen_async_request(), waits for the descriptor from pgen_async_fd() to
+ * become readable (poll, epoll, io_uring, ...) and then collects the batch
+ * with pgen_async_take(). Neither call waits on the pseudorandom device.
+ */
+struct pgen_async {
+    const struct gen_prog   *prog;
+    struct entropy          src;
+    pthread_t               thread;
+    pthread_mutex_t         lock;
+    pthread_cond_t          refill;
+    char                    *reserve;       // ring of cap slots
+    size_t                  slot_size;
+    size_t                  cap;
+    size_t                  head;           // next slot to take
+    size_t                  count;          // slots filled
+    size_t                  want;           // pending request, 0 if none
+    int                     notify[2];      // pipe, read end is pollable
+    int                     stop;
+    int                     failed;
+};
+
+int pgen_async_init(struct pgen_async *as, const struct gen_prog *prog,
+                    size_t reserve);
+void pgen_async_destroy(struct pgen_async *as);
+int pgen_async_fd(const struct pgen_async *as);
+int pgen_async_request(struct pgen_async *as, size_t n);
+size_t pgen_async_take(struct pgen_async *as, char *out, size_t n);
+int pgen_async_failed(struct pgen_async *as);
+
+#endif  /* ASYNC_H */
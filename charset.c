@@ -16,6 +16,18 @@ cmpchar(const void *c1, const void *c2)
     return *(char *) c1 - *(char *) c2;
 }
 
+/**
+ * Returns nonzero if character c belongs to one of the classes set in opt
+ */
+int
+in_charset(charset_opt_t opt, int c)
+{
+    return (opt & LOWER && islower(c)) ||
+           (opt & UPPER && isupper(c)) ||
+           (opt & DIGIT && isdigit(c)) ||
+           (opt & PUNCT && ispunct(c));
+}
+
 /**
  * Returns a null terminated character array to be used as symbol lookup table.
  * include/exclude should be a list of characters in the form of a sorted
@@ -36,10 +48,7 @@ generate_charset(charset_opt_t opt, const char *exclude, const char *include)
         int     disallowed  = 0;
 
         // allow according to options/include list
-        if ((opt & LOWER && islower(i)) ||
-            (opt & UPPER && isupper(i)) ||
-            (opt & DIGIT && isdigit(i)) ||
-            (opt & PUNCT && ispunct(i)) ||
+        if (in_charset(opt, i) ||
             (include && bsearch(&i, include, strlen(include),
                                 sizeof(char), cmpchar))) 
         {
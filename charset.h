@@ -10,6 +10,7 @@ typedef enum {
 } charset_opt_t;
 
 int cmpchar(const void *c1, const void *c2);
+int in_charset(charset_opt_t opt, int c);
 char *generate_charset(charset_opt_t opt, const char *exclude, const char *include);
 
 #endif
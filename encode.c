@@ -0,0 +1,197 @@
+/*****************************************************************************
+ * Binary to text key encodings for pgen
+ *
+ * Keys are random bytes encoded directly: every hex, base32 or base64
+ * character is a fixed group of bits, so no draw is ever rejected. Bytes are
+ * taken and encoded a chunk at a time with table lookups in fixed trip count
+ * loops, which the compiler can unroll and vectorize. Base58 does not divide
+ * a byte evenly, each character is a byte drawn below 4 * 58 and reduced
+ * modulo 58, which is exactly uniform.
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "encode.h"
+
+#define CHUNK_CHARS     64      // characters encoded per chunk
+
+static const struct {
+    const char  *name;
+    encoding_t  enc;
+    const char  *alphabet;
+} encodings[] = {
+    { "hex",       ENC_HEX,       "0123456789abcdef" },
+    { "base32",    ENC_BASE32,    "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567" },
+    { "base64",    ENC_BASE64,
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/" },
+    { "base64url", ENC_BASE64URL,
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_" },
+    { "base58",    ENC_BASE58,
+      "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz" },
+};
+
+#define NENCODINGS  (sizeof encodings / sizeof *encodings)
+
+/**
+ * Looks up an encoding by name. Returns 1 on success, on failure an error
+ * is printed to stderr and 0 is returned.
+ */
+int
+encoding_parse(const char *name, encoding_t *enc)
+{
+    for (size_t i = 0; i < NENCODINGS; ++i) {
+        if (!strcmp(name, encodings[i].name)) {
+            *enc = encodings[i].enc;
+            return 1;
+        }
+    }
+    fprintf(stderr, "E: unknown encoding '%s'\n", name);
+
+    return 0;
+}
+
+const char *
+encoding_alphabet(encoding_t enc)
+{
+    for (size_t i = 0; i < NENCODINGS; ++i)
+        if (encodings[i].enc == enc)
+            return encodings[i].alphabet;
+
+    return "";
+}
+
+/**
+ * Returns the number of characters needed for a key of at least bits bits
+ */
+size_t
+encoding_len(encoding_t enc, long bits)
+{
+    switch (enc) {
+    case ENC_HEX:
+        return (bits + 3) / 4;
+    case ENC_BASE32:
+        return (bits + 4) / 5;
+    case ENC_BASE64:
+    case ENC_BASE64URL:
+        return (bits + 5) / 6;
+    case ENC_BASE58:
+        return (size_t) ceil(bits / log2(58));
+    default:
+        return 0;
+    }
+}
+
+/*
+ * Each encoder fills n <= CHUNK_CHARS characters of out from in, which
+ * holds enough bytes for a full chunk
+ */
+static void
+encode_hex(const unsigned char *in, char *out, size_t n, const char *abc)
+{
+    char tmp[CHUNK_CHARS];
+
+    for (size_t i = 0; i < CHUNK_CHARS / 2; ++i) {
+        tmp[2 * i]     = abc[in[i] >> 4];
+        tmp[2 * i + 1] = abc[in[i] & 0x0f];
+    }
+    memcpy(out, tmp, n);
+}
+
+static void
+encode_base32(const unsigned char *in, char *out, size_t n, const char *abc)
+{
+    char tmp[CHUNK_CHARS];
+
+    for (size_t i = 0; i < CHUNK_CHARS / 8; ++i, in += 5) {
+        unsigned long long w = (unsigned long long) in[0] << 32 |
+                               (unsigned long long) in[1] << 24 |
+                               (unsigned long long) in[2] << 16 |
+                               (unsigned long long) in[3] << 8 | in[4];
+
+        for (int j = 0; j < 8; ++j)
+            tmp[8 * i + j] = abc[(w >> (35 - 5 * j)) & 0x1f];
+    }
+    memcpy(out, tmp, n);
+}
+
+static void
+encode_base64(const unsigned char *in, char *out, size_t n, const char *abc)
+{
+    char tmp[CHUNK_CHARS];
+
+    for (size_t i = 0; i < CHUNK_CHARS / 4; ++i, in += 3) {
+        unsigned long w = (unsigned long) in[0] << 16 |
+                          (unsigned long) in[1] << 8 | in[2];
+
+        tmp[4 * i]     = abc[(w >> 18) & 0x3f];
+        tmp[4 * i + 1] = abc[(w >> 12) & 0x3f];
+        tmp[4 * i + 2] = abc[(w >> 6) & 0x3f];
+        tmp[4 * i + 3] = abc[w & 0x3f];
+    }
+    memcpy(out, tmp, n);
+}
+
+/**
+ * Writes a random key of len characters in encoding enc to out, followed by
+ * a terminator. Returns 1 on success, 0 on failure.
+ */
+int
+encode_key(encoding_t enc, struct entropy *src, char *out, size_t len)
+{
+    const char      *abc = encoding_alphabet(enc);
+    unsigned char   in[CHUNK_CHARS] = { 0 };    // a chunk of any encoding
+    size_t          chunk_bytes;
+    void            (*encode)(const unsigned char *, char *, size_t,
+                              const char *);
+
+    switch (enc) {
+    case ENC_HEX:
+        chunk_bytes = CHUNK_CHARS / 2;
+        encode      = encode_hex;
+        break;
+    case ENC_BASE32:
+        chunk_bytes = CHUNK_CHARS / 8 * 5;
+        encode      = encode_base32;
+        break;
+    case ENC_BASE64:
+    case ENC_BASE64URL:
+        chunk_bytes = CHUNK_CHARS / 4 * 3;
+        encode      = encode_base64;
+        break;
+    case ENC_BASE58:
+        for (size_t i = 0; i < len; ) {
+            // 232 of 256 byte values are kept, ask for what is left on average
+            size_t want = len - i < sizeof in
+                          ? ((len - i) * 256 + 4 * 58 - 1) / (4 * 58) : sizeof in;
+
+            if (want > sizeof in)
+                want = sizeof in;
+            if (!entropy_read(src, in, want))
+                return 0;
+            for (size_t j = 0; j < want && i < len; ++j)
+                if (in[j] < 4 * 58)
+                    out[i++] = abc[in[j] % 58];
+        }
+        memset(in, 0, sizeof in);
+        out[len] = '\0';
+        return 1;
+    default:
+        return 0;
+    }
+
+    for (size_t i = 0; i < len; i += CHUNK_CHARS) {
+        size_t n = len - i < CHUNK_CHARS ? len - i : CHUNK_CHARS;
+
+        // only take the bytes the last, partial chunk actually uses
+        if (!entropy_read(src, in, n == CHUNK_CHARS ? chunk_bytes
+                                   : (n * chunk_bytes + CHUNK_CHARS - 1) / CHUNK_CHARS))
+            return 0;
+        encode(in, out + i, n, abc);
+    }
+    memset(in, 0, sizeof in);
+    out[len] = '\0';
+
+    return 1;
+}
@@ -0,0 +1,22 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stddef.h>
+
+#include "entropy.h"
+
+typedef enum {
+    ENC_NONE,
+    ENC_HEX,
+    ENC_BASE32,
+    ENC_BASE64,
+    ENC_BASE64URL,
+    ENC_BASE58,
+} encoding_t;
+
+int encoding_parse(const char *name, encoding_t *enc);
+const char *encoding_alphabet(encoding_t enc);
+size_t encoding_len(encoding_t enc, long bits);
+int encode_key(encoding_t enc, struct entropy *src, char *out, size_t len);
+
+#endif  /* ENCODE_H */
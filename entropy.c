@@ -0,0 +1,282 @@
+/*****************************************************************************
+ * Buffered pseudorandom source for pgen
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "entropy.h"
+
+#if ENTROPY_BUF_SIZE % ENTROPY_APT_WINDOW
+#error "ENTROPY_APT_WINDOW must divide ENTROPY_BUF_SIZE"
+#endif
+
+/*
+ * Runs the continuous health tests over a freshly read block. The checks
+ * within the block are written as fixed length compare and count loops the
+ * compiler turns into vector code, only runs crossing block boundaries are
+ * followed byte by byte. Returns 1 if the block passes, otherwise an error
+ * is printed to stderr and 0 is returned.
+ */
+static int
+health_test(struct entropy_health *h, const unsigned char *b)
+{
+    const size_t    n       = ENTROPY_BUF_SIZE;
+    unsigned char   hits    = 0;
+    unsigned        repeats = h->bytes && b[0] == h->rct_last;
+    size_t          i;
+
+    // repetition count test, first the run carried over from the last block
+    for (i = 0; i < n && b[i] == h->rct_last; ++i)
+        if (++h->rct_run >= ENTROPY_RCT_CUTOFF)
+            goto rct_fail;
+
+    // then any run that starts within the block
+    for (i = 0; i + ENTROPY_RCT_CUTOFF <= n; ++i) {
+        unsigned char same = 1;
+
+        for (size_t k = 1; k < ENTROPY_RCT_CUTOFF; ++k)
+            same &= b[i + k] == b[i];
+        hits |= same;
+    }
+    if (hits)
+        goto rct_fail;
+
+    for (i = 1; i < n; ++i)
+        repeats += b[i] == b[i - 1];
+
+    // remember the trailing run for the next block
+    for (i = n - 1; i > 0 && b[i - 1] == b[n - 1]; --i)
+        ;
+    h->rct_last = b[n - 1];
+    h->rct_run  = (unsigned) (n - i);
+
+    // adaptive proportion test over consecutive windows
+    for (size_t w = 0; w < n; w += ENTROPY_APT_WINDOW) {
+        unsigned count = 0;
+
+        for (i = 0; i < ENTROPY_APT_WINDOW; ++i)
+            count += b[w + i] == b[w];
+        if (count > h->apt_max)
+            h->apt_max = count;
+        if (count >= ENTROPY_APT_CUTOFF) {
+            fprintf(stderr, "E: entropy source failed adaptive proportion test "
+                    "(%u of %d bytes equal)\n", count, ENTROPY_APT_WINDOW);
+            return 0;
+        }
+    }
+
+    h->bytes   += n;
+    h->repeats += repeats;
+
+    return 1;
+
+rct_fail:
+    fprintf(stderr, "E: entropy source failed repetition count test "
+            "(%d identical bytes in a row)\n", ENTROPY_RCT_CUTOFF);
+    return 0;
+}
+
+/*
+ * Refills the buffer from the device. Returns 1 on success, on failure an
+ * error is printed to stderr and 0 is returned.
+ */
+static int
+refill(struct entropy *src)
+{
+    size_t got = 0;
+
+    if (src->fd == -1) {
+        for (; got < ENTROPY_BUF_SIZE; got += sizeof(uint64_t)) {
+            uint64_t r = entropy_insecure_u64(src);
+
+            memcpy(src->buf + got, &r, sizeof r);
+        }
+        src->pos = 0;
+        src->len = got;
+
+        return 1;
+    }
+
+    while (got < ENTROPY_BUF_SIZE) {
+        ssize_t n = read(src->fd, src->buf + got, ENTROPY_BUF_SIZE - got);
+
+        if (n == -1) {
+            perror("read");
+            return 0;
+        } else if (n == 0) {
+            fprintf(stderr, "E: unexpected end of pseudorandom source\n");
+            return 0;
+        }
+        got += n;
+    }
+    if (src->health.failed || !health_test(&src->health, src->buf)) {
+        src->health.failed = 1;
+        memset(src->buf, 0, ENTROPY_BUF_SIZE);
+        return 0;
+    }
+    src->pos = 0;
+    src->len = got;
+
+    return 1;
+}
+
+/**
+ * Opens the pseudorandom device at path. Returns 1 on success, on failure
+ * an error is printed to stderr and 0 is returned.
+ */
+int
+entropy_open(struct entropy *src, const char *path)
+{
+    if ((src->fd = open(path, O_RDONLY)) == -1) {
+        perror("open");
+        return 0;
+    }
+    src->pos = src->len = 0;
+    memset(&src->health, 0, sizeof(struct entropy_health));
+
+    return 1;
+}
+
+/**
+ * Sets up src as an insecure source, a xoshiro256** generator started from
+ * seed. Distinct streams for several threads are made by copying a source
+ * and calling entropy_jump on each copy. Returns 1 on success, on failure an
+ * error is printed to stderr and 0 is returned.
+ */
+int
+entropy_open_insecure(struct entropy *src, const uint64_t seed[4])
+{
+    if (!(seed[0] | seed[1] | seed[2] | seed[3])) {
+        fprintf(stderr, "E: insecure generator seed must not be all zero\n");
+        return 0;
+    }
+    src->fd  = -1;
+    src->pos = src->len = 0;
+    memcpy(src->xs, seed, sizeof src->xs);
+    memset(&src->health, 0, sizeof(struct entropy_health));
+
+    return 1;
+}
+
+/**
+ * Advances an insecure source by 2^128 steps, as if that many values had
+ * been drawn. Buffered values are dropped.
+ */
+void
+entropy_jump(struct entropy *src)
+{
+    static const uint64_t jump[] = {
+        UINT64_C(0x180ec6d33cfd0aba), UINT64_C(0xd5a61266f0c9392c),
+        UINT64_C(0xa9582618e03fc9aa), UINT64_C(0x39abdc4529b1661c)
+    };
+    uint64_t s[4] = { 0, 0, 0, 0 };
+
+    for (size_t i = 0; i < sizeof jump / sizeof *jump; ++i) {
+        for (int b = 0; b < 64; ++b) {
+            if (jump[i] & UINT64_C(1) << b) {
+                s[0] ^= src->xs[0];
+                s[1] ^= src->xs[1];
+                s[2] ^= src->xs[2];
+                s[3] ^= src->xs[3];
+            }
+            entropy_insecure_u64(src);
+        }
+    }
+    memcpy(src->xs, s, sizeof s);
+    src->pos = src->len = 0;
+}
+
+/**
+ * Prints the health test statistics of a device source to stderr
+ */
+void
+entropy_report(const struct entropy *src)
+{
+    const struct entropy_health *h = &src->health;
+
+    fprintf(stderr, "health: %llu bytes tested, %s\n"
+            "health: repetition count: %llu repeated bytes (%.4f%%, expect "
+            "%.4f%%), cutoff %d in a row\n"
+            "health: adaptive proportion: highest count %u of %d, cutoff %d\n",
+            (unsigned long long) h->bytes, h->failed ? "FAILED" : "passed",
+            (unsigned long long) h->repeats,
+            h->bytes ? 100.0 * h->repeats / h->bytes : 0.0, 100.0 / 256,
+            ENTROPY_RCT_CUTOFF, h->apt_max, ENTROPY_APT_WINDOW,
+            ENTROPY_APT_CUTOFF);
+}
+
+/**
+ * Closes the device and wipes any buffered bytes
+ */
+void
+entropy_close(struct entropy *src)
+{
+    if (src->fd != -1)
+        close(src->fd);
+    memset(src, 0, sizeof(struct entropy));
+    src->fd = -1;
+}
+
+/**
+ * Copies n pseudorandom bytes to out. Returns 1 on success, 0 on failure.
+ */
+int
+entropy_read(struct entropy *src, void *out, size_t n)
+{
+    unsigned char *p = out;
+
+    while (n) {
+        size_t chunk;
+
+        if (src->pos == src->len && !refill(src))
+            return 0;
+
+        chunk = src->len - src->pos;
+        if (chunk > n)
+            chunk = n;
+        memcpy(p, src->buf + src->pos, chunk);
+        memset(src->buf + src->pos, 0, chunk);
+        src->pos += chunk;
+        p += chunk;
+        n -= chunk;
+    }
+
+    return 1;
+}
+
+/**
+ * Draws a 32 bit pseudorandom value. Returns 1 on success, 0 on failure.
+ */
+int
+entropy_u32(struct entropy *src, uint32_t *out)
+{
+    return entropy_read(src, out, sizeof *out);
+}
+
+/**
+ * Draws a value uniformly distributed over [0, n), n must be nonzero.
+ * Draws past the largest multiple of n are rejected to ensure against
+ * modulo bias. Returns 1 on success, 0 on failure.
+ */
+int
+entropy_uniform(struct entropy *src, uint32_t n, uint32_t *out)
+{
+    uint32_t max_rand = UINT32_MAX - ((uint64_t) UINT32_MAX + 1) % n;
+    uint32_t rand;
+
+    do {
+        if (!entropy_u32(src, &rand))
+            return 0;
+    } while (rand > max_rand);
+
+    *out = rand % n;
+
+    return 1;
+}
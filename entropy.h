@@ -0,0 +1,83 @@
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ENTROPY_PATH        "/dev/urandom"
+#define ENTROPY_BUF_SIZE    4096
+
+/*
+ * Continuous health test cutoffs after NIST SP 800-90B 4.4, for byte samples
+ * with a claimed min-entropy of 4 bits each and a false alarm probability of
+ * 2^-40 per test. The claim is deliberately half of what the device should
+ * deliver, which keeps false alarms negligible at high volume while stuck or
+ * grossly biased output still fails within a block.
+ */
+#define ENTROPY_RCT_CUTOFF  11          // identical bytes in a row
+#define ENTROPY_APT_WINDOW  512         // divides ENTROPY_BUF_SIZE
+#define ENTROPY_APT_CUTOFF  78          // window bytes equal to its first
+
+/*
+ * Health test state and statistics of a device source
+ */
+struct entropy_health {
+    uint64_t        bytes;              // bytes tested
+    uint64_t        repeats;            // bytes equal to the one before
+    unsigned        rct_run;            // current run, continued across blocks
+    unsigned        apt_max;            // highest adaptive proportion count
+    unsigned char   rct_last;
+    int             failed;
+};
+
+/*
+ * Buffered reader over a pseudorandom device. Random bytes are read in blocks
+ * of ENTROPY_BUF_SIZE and handed out from the buffer, so drawing a symbol
+ * does not cost a system call. Every block passes the repetition count and
+ * adaptive proportion tests before any of it is used; once a block fails,
+ * the source refuses to deliver more.
+ *
+ * A source opened with entropy_open_insecure has no device (fd is -1) and
+ * fills the buffer from the xoshiro256** generator state in xs instead. It
+ * is fast and statistically sound but predictable, for test data only.
+ */
+struct entropy {
+    int             fd;
+    size_t          pos;
+    size_t          len;
+    uint64_t        xs[4];
+    struct entropy_health health;
+    unsigned char   buf[ENTROPY_BUF_SIZE];
+};
+
+int entropy_open(struct entropy *src, const char *path);
+int entropy_open_insecure(struct entropy *src, const uint64_t seed[4]);
+void entropy_jump(struct entropy *src);
+void entropy_report(const struct entropy *src);
+void entropy_close(struct entropy *src);
+int entropy_read(struct entropy *src, void *out, size_t n);
+int entropy_u32(struct entropy *src, uint32_t *out);
+int entropy_uniform(struct entropy *src, uint32_t n, uint32_t *out);
+
+/*
+ * Steps the xoshiro256** state of an insecure source, bypassing the buffer
+ */
+static inline uint64_t
+entropy_insecure_u64(struct entropy *src)
+{
+    uint64_t *s     = src->xs;
+    uint64_t x      = s[1] * 5;
+    uint64_t result = ((x << 7) | (x >> 57)) * 9;
+    uint64_t t      = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3]  = (s[3] << 45) | (s[3] >> 19);
+
+    return result;
+}
+
+#endif  /* ENTROPY_H */
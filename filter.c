@@ -0,0 +1,418 @@
+/*****************************************************************************
+ * Denylist filter for pgen
+ *
+ * A denylist is compiled into an xor filter with 8-bit fingerprints, which
+ * takes about 9.84 bits per entry regardless of how long the entries are. A
+ * lookup hashes the candidate once and xors three bytes, one from each third
+ * of the fingerprint array, so it costs at most three cache misses. The
+ * filter file is mapped read only and used in place, nothing is parsed at
+ * startup.
+ *
+ * The filter has no false negatives. Roughly 1 in 256 strings that are not
+ * in the list will also be reported as present; for pgen this only means
+ * that such a candidate is thrown away and generated again.
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "filter.h"
+
+#define FILTER_MAX_ATTEMPTS     100
+
+struct filter_set {
+    uint64_t    xormask;
+    uint32_t    count;
+};
+
+struct filter_keyindex {
+    uint64_t    hash;
+    uint32_t    index;
+};
+
+static uint64_t
+rotl64(uint64_t n, unsigned int c)
+{
+    return (n << (c & 63)) | (n >> ((-c) & 63));
+}
+
+/*
+ * Maps a 32 bit hash into [0, n) without a division
+ */
+static uint32_t
+reduce(uint32_t hash, uint32_t n)
+{
+    return (uint32_t) (((uint64_t) hash * n) >> 32);
+}
+
+/*
+ * Final avalanche step of MurmurHash3, used to combine key hash and seed
+ */
+static uint64_t
+mix64(uint64_t h)
+{
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    h *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h ^= h >> 33;
+
+    return h;
+}
+
+static uint64_t
+splitmix64(uint64_t *state)
+{
+    uint64_t z = (*state += UINT64_C(0x9e3779b97f4a7c15));
+
+    z = (z ^ (z >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+    z = (z ^ (z >> 27)) * UINT64_C(0x94d049bb133111eb);
+
+    return z ^ (z >> 31);
+}
+
+static uint8_t
+fingerprint(uint64_t hash)
+{
+    return (uint8_t) (hash ^ (hash >> 32));
+}
+
+static void
+filter_slots(uint64_t hash, uint32_t block_len, uint32_t h[3])
+{
+    h[0] = reduce((uint32_t) hash, block_len);
+    h[1] = reduce((uint32_t) rotl64(hash, 21), block_len) + block_len;
+    h[2] = reduce((uint32_t) rotl64(hash, 42), block_len) + 2 * block_len;
+}
+
+static int
+cmpu64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/**
+ * Hashes n bytes of s into h (FNV-1a). Start with h = FILTER_HASH_BASIS;
+ * strings that are split into several pieces, such as prefix and password,
+ * may be hashed by chaining calls.
+ */
+uint64_t
+filter_hash(uint64_t h, const char *s, size_t n)
+{
+    for (size_t i = 0; i < n; ++i) {
+        h ^= (unsigned char) s[i];
+        h *= UINT64_C(0x100000001b3);
+    }
+
+    return h;
+}
+
+/**
+ * Returns 1 if key, as computed by filter_hash, is (probably) in the filter,
+ * and 0 if it is certainly not.
+ */
+int
+filter_contains(const struct filter *filter, uint64_t key)
+{
+    uint64_t    hash = mix64(key + filter->hdr->seed);
+    uint32_t    h[3];
+
+    filter_slots(hash, (uint32_t) filter->hdr->block_len, h);
+
+    return fingerprint(hash) ==
+           (filter->fp[h[0]] ^ filter->fp[h[1]] ^ filter->fp[h[2]]);
+}
+
+/**
+ * Maps the filter file at path into memory. Returns 1 on success, on failure
+ * an error is printed to stderr and 0 is returned.
+ */
+int
+filter_open(struct filter *filter, const char *path)
+{
+    struct stat st;
+    void        *map;
+    int         fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        perror(path);
+        return 0;
+    }
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return 0;
+    }
+    if ((size_t) st.st_size < sizeof(struct filter_header)) {
+        fprintf(stderr, "E: %s: not a pgen filter file\n", path);
+        close(fd);
+        return 0;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+
+    filter->hdr     = map;
+    filter->fp      = (const uint8_t *) map + sizeof(struct filter_header);
+    filter->map_len = st.st_size;
+
+    if (memcmp(filter->hdr->magic, FILTER_MAGIC, sizeof filter->hdr->magic) ||
+        filter->hdr->block_len == 0 || filter->hdr->block_len > UINT32_MAX / 3 ||
+        filter->map_len - sizeof(struct filter_header) !=
+            3 * filter->hdr->block_len)
+    {
+        fprintf(stderr, "E: %s: not a pgen filter file\n", path);
+        filter_close(filter);
+        return 0;
+    }
+
+    return 1;
+}
+
+void
+filter_close(struct filter *filter)
+{
+    if (filter->hdr)
+        munmap((void *) filter->hdr, filter->map_len);
+    memset(filter, 0, sizeof(struct filter));
+}
+
+/*
+ * Hashes every line of the list into keys, returns the number of distinct
+ * keys. Empty lines are skipped, a trailing carriage return is dropped.
+ */
+static size_t
+hash_lines(const char *text, size_t len, uint64_t *keys)
+{
+    const char  *p   = text;
+    const char  *end = text + len;
+    size_t      n    = 0;
+
+    while (p < end) {
+        const char  *eol = memchr(p, '\n', end - p);
+        size_t      llen;
+
+        if (!eol)
+            eol = end;
+        llen = eol - p;
+        if (llen && p[llen - 1] == '\r')
+            --llen;
+        if (llen)
+            keys[n++] = filter_hash(FILTER_HASH_BASIS, p, llen);
+        p = eol + 1;
+    }
+
+    // duplicate keys would make the filter impossible to construct
+    qsort(keys, n, sizeof(uint64_t), cmpu64);
+    if (n) {
+        size_t j = 0;
+
+        for (size_t i = 1; i < n; ++i)
+            if (keys[i] != keys[j])
+                keys[++j] = keys[i];
+        n = j + 1;
+    }
+
+    return n;
+}
+
+/*
+ * Computes fingerprints for keys into fp (3 * block_len bytes). Returns the
+ * seed used on success, 0 is never returned as a seed and indicates failure.
+ */
+static uint64_t
+construct(const uint64_t *keys, size_t nkeys, uint32_t block_len, uint8_t *fp)
+{
+    size_t                  capacity = 3 * (size_t) block_len;
+    struct filter_set       *sets;
+    struct filter_keyindex  *queue;
+    struct filter_keyindex  *stack;
+    uint64_t                rng      = UINT64_C(0x726b2b9d438b9d4d);
+    uint64_t                seed     = 0;
+
+    sets  = malloc(capacity * sizeof(struct filter_set));
+    queue = malloc(capacity * sizeof(struct filter_keyindex));
+    stack = malloc((nkeys ? nkeys : 1) * sizeof(struct filter_keyindex));
+    if (!sets || !queue || !stack) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        goto done;
+    }
+
+    for (int attempt = 0; attempt < FILTER_MAX_ATTEMPTS; ++attempt) {
+        size_t      qsize = 0;
+        size_t      ssize = 0;
+        uint64_t    s;
+
+        while (!(s = splitmix64(&rng)))
+            ;
+        memset(sets, 0, capacity * sizeof(struct filter_set));
+
+        for (size_t i = 0; i < nkeys; ++i) {
+            uint64_t    hash = mix64(keys[i] + s);
+            uint32_t    h[3];
+
+            filter_slots(hash, block_len, h);
+            for (int j = 0; j < 3; ++j) {
+                sets[h[j]].xormask ^= hash;
+                sets[h[j]].count++;
+            }
+        }
+
+        for (size_t i = 0; i < capacity; ++i) {
+            if (sets[i].count == 1) {
+                queue[qsize].index = (uint32_t) i;
+                queue[qsize].hash  = sets[i].xormask;
+                ++qsize;
+            }
+        }
+
+        // peel slots holding a single key until none are left
+        while (qsize) {
+            struct filter_keyindex  ki = queue[--qsize];
+            uint32_t                h[3];
+
+            if (sets[ki.index].count != 1)
+                continue;
+            stack[ssize++] = ki;
+
+            filter_slots(ki.hash, block_len, h);
+            for (int j = 0; j < 3; ++j) {
+                sets[h[j]].xormask ^= ki.hash;
+                if (--sets[h[j]].count == 1) {
+                    queue[qsize].index = h[j];
+                    queue[qsize].hash  = sets[h[j]].xormask;
+                    ++qsize;
+                }
+            }
+        }
+
+        if (ssize != nkeys)
+            continue;
+
+        // assign in reverse peeling order, each key owns the slot it left by
+        memset(fp, 0, capacity);
+        while (ssize) {
+            struct filter_keyindex  ki = stack[--ssize];
+            uint32_t                h[3];
+
+            filter_slots(ki.hash, block_len, h);
+            fp[ki.index] = 0;
+            fp[ki.index] = fingerprint(ki.hash) ^ fp[h[0]] ^ fp[h[1]] ^ fp[h[2]];
+        }
+        seed = s;
+        break;
+    }
+
+    if (!seed)
+        fprintf(stderr, "E: failed to construct filter\n");
+
+done:
+    free(sets);
+    free(queue);
+    free(stack);
+    return seed;
+}
+
+/**
+ * Compiles the newline separated list at list_path into a filter file at
+ * filter_path. Returns 1 on success, on failure an error is printed to
+ * stderr and 0 is returned.
+ */
+int
+filter_build(const char *list_path, const char *filter_path)
+{
+    struct filter_header    hdr;
+    struct stat             st;
+    char                    *text     = NULL;
+    uint64_t                *keys     = NULL;
+    uint8_t                 *fp       = NULL;
+    size_t                  nkeys     = 0;
+    size_t                  lines     = 1;
+    uint64_t                block_len;
+    int                     fd;
+    int                     ret       = 0;
+
+    if ((fd = open(list_path, O_RDONLY)) == -1) {
+        perror(list_path);
+        return 0;
+    }
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return 0;
+    }
+    if (st.st_size > 0) {
+        text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (text == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return 0;
+        }
+    }
+    close(fd);
+
+    for (off_t i = 0; i < st.st_size; ++i)
+        lines += text[i] == '\n';
+
+    if (!(keys = malloc(lines * sizeof(uint64_t)))) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        goto done;
+    }
+    nkeys = hash_lines(text, st.st_size, keys);
+
+    block_len = (32 + (123 * (uint64_t) nkeys + 99) / 100 + 2) / 3;
+    if (block_len > UINT32_MAX / 3) {
+        fprintf(stderr, "E: %s: too many entries\n", list_path);
+        goto done;
+    }
+    if (!(fp = malloc(3 * block_len))) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        goto done;
+    }
+
+    memset(&hdr, 0, sizeof hdr);
+    memcpy(hdr.magic, FILTER_MAGIC, sizeof hdr.magic);
+    hdr.block_len = block_len;
+    hdr.nkeys     = nkeys;
+    if (!(hdr.seed = construct(keys, nkeys, (uint32_t) block_len, fp)))
+        goto done;
+
+    if ((fd = open(filter_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+        perror(filter_path);
+        goto done;
+    }
+    if (write(fd, &hdr, sizeof hdr) != (ssize_t) sizeof hdr ||
+        write(fd, fp, 3 * block_len) != (ssize_t) (3 * block_len))
+    {
+        perror("write");
+        close(fd);
+        goto done;
+    }
+    if (close(fd) == -1) {
+        perror("close");
+        goto done;
+    }
+    ret = 1;
+
+done:
+    if (text)
+        munmap(text, st.st_size);
+    free(keys);
+    free(fp);
+    return ret;
+}
@@ -0,0 +1,34 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FILTER_MAGIC        "PGENXOR8"
+#define FILTER_HASH_BASIS   UINT64_C(0xcbf29ce484222325)
+
+/*
+ * On-disk layout of a denylist filter: this header, immediately followed by
+ * 3 * block_len one byte fingerprints. Fields are stored in host byte order,
+ * the file is meant to be built on (or for) the machine that uses it.
+ */
+struct filter_header {
+    char        magic[8];
+    uint64_t    seed;
+    uint64_t    block_len;
+    uint64_t    nkeys;
+};
+
+struct filter {
+    const struct filter_header  *hdr;
+    const uint8_t               *fp;
+    size_t                      map_len;
+};
+
+uint64_t filter_hash(uint64_t h, const char *s, size_t n);
+int filter_contains(const struct filter *filter, uint64_t key);
+int filter_open(struct filter *filter, const char *path);
+void filter_close(struct filter *filter);
+int filter_build(const char *list_path, const char *filter_path);
+
+#endif  /* FILTER_H */
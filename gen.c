@@ -0,0 +1,359 @@
+/*****************************************************************************
+ * Generator programs for pgen
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gen.h"
+#include "slice.h"
+
+#define GEN_MAX_RESTART     100000  // forbidden substring hits in a row
+
+struct gen_job {
+    const struct gen_prog   *prog;
+    struct entropy          *srcs;
+    char                    *recs;
+    size_t                  rec_size;
+    size_t                  offset;
+};
+
+/**
+ * Sets up prog to generate strings of length len from table, the plain
+ * single op program used when no pattern is given. table and alias are
+ * referenced, not copied. Returns 1 on success, 0 on failure.
+ */
+int
+gen_prog_uniform(struct gen_prog *prog, const char *table,
+                 const struct alias_table *alias, size_t len)
+{
+    memset(prog, 0, sizeof(struct gen_prog));
+
+    if (!(prog->ops = malloc(sizeof(struct gen_op)))) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        return 0;
+    }
+    prog->ops->table     = table;
+    prog->ops->table_len = strlen(table);
+    prog->ops->alias     = alias;
+    prog->ops->run       = len;
+    prog->nops           = 1;
+    prog->len            = len;
+
+    return 1;
+}
+
+/**
+ * Sets up prog to generate keys of len characters in encoding enc. Returns 1
+ * on success, 0 on failure.
+ */
+int
+gen_prog_key(struct gen_prog *prog, encoding_t enc, size_t len)
+{
+    if (!gen_prog_uniform(prog, encoding_alphabet(enc), NULL, len))
+        return 0;
+    prog->enc = enc;
+
+    return 1;
+}
+
+void
+gen_prog_free(struct gen_prog *prog)
+{
+    free(prog->ops);
+    free(prog->strtab);
+    memset(prog, 0, sizeof(struct gen_prog));
+}
+
+/**
+ * Makes prog reject strings containing any of the forbidden substrings in
+ * dfa, counting from the start of prefix, which may be NULL, so that
+ * substrings spanning prefix and generated string are caught too. Returns
+ * 1 on success, if the prefix itself contains a forbidden substring an error
+ * is printed to stderr and 0 is returned.
+ */
+int
+gen_prog_forbid(struct gen_prog *prog, const struct ac_dfa *dfa,
+                const char *prefix)
+{
+    uint32_t state = 0;
+
+    for (const char *p = prefix; p && *p; ++p) {
+        state = AC_STEP(dfa, state, *p);
+        if (dfa->match[state]) {
+            fprintf(stderr, "E: prefix '%s' contains a forbidden substring\n",
+                    prefix);
+            return 0;
+        }
+    }
+    prog->dfa       = dfa;
+    prog->dfa_start = state;
+
+    return 1;
+}
+
+/**
+ * Returns the entropy in bits of a string generated by prog
+ */
+double
+gen_prog_entropy(const struct gen_prog *prog)
+{
+    double bits = 0;
+
+    for (size_t i = 0; i < prog->nops; ++i) {
+        const struct gen_op *op = &prog->ops[i];
+
+        bits += op->run * (op->alias ? op->alias->entropy : log2(op->table_len));
+    }
+
+    return bits;
+}
+
+/**
+ * Sets alphabet[c] to 1 for every byte c prog can generate, and to 0 for
+ * all others
+ */
+void
+gen_prog_alphabet(const struct gen_prog *prog, unsigned char alphabet[256])
+{
+    memset(alphabet, 0, 256);
+    for (size_t i = 0; i < prog->nops; ++i)
+        for (size_t j = 0; j < prog->ops[i].table_len; ++j)
+            alphabet[(unsigned char) prog->ops[i].table[j]] = 1;
+}
+
+/*
+ * Draws one symbol for op into c. Returns 1 on success, 0 on failure.
+ */
+static int
+draw(const struct gen_op *op, struct entropy *src, char *c)
+{
+    if (op->table_len == 1) {
+        *c = *op->table;
+    } else if (op->alias) {
+        size_t sym;
+
+        if (!alias_sample(op->alias, src, &sym))
+            return 0;
+        *c = op->table[sym];
+    } else {
+        uint32_t sym;
+
+        if (!entropy_uniform(src, (uint32_t) op->table_len, &sym))
+            return 0;
+        *c = op->table[sym];
+    }
+
+    return 1;
+}
+
+/*
+ * gen_run() for key encodings. Keys are encoded whole, then scanned for
+ * forbidden substrings if necessary.
+ */
+static int
+run_key(const struct gen_prog *prog, struct entropy *src, char *out)
+{
+    const struct ac_dfa *dfa = prog->dfa;
+
+    for (long tries = 0; tries < GEN_MAX_RESTART; ++tries) {
+        uint32_t    state = prog->dfa_start;
+        size_t      i;
+
+        if (!encode_key(prog->enc, src, out, prog->len))
+            return 0;
+        if (!dfa)
+            return 1;
+
+        for (i = 0; i < prog->len; ++i) {
+            state = AC_STEP(dfa, state, out[i]);
+            if (dfa->match[state])
+                break;
+        }
+        if (i == prog->len)
+            return 1;
+    }
+    fprintf(stderr, "E: forbidden substrings rejected %d candidates in a row\n",
+            GEN_MAX_RESTART);
+
+    return 0;
+}
+
+/*
+ * gen_run() with forbidden substring scanning. Each symbol advances the
+ * automaton as it is generated, so a candidate is dropped at the first
+ * symbol completing a forbidden substring. Starting over rather than
+ * redrawing the last symbol keeps accepted strings uniformly distributed.
+ */
+static int
+run_scanned(const struct gen_prog *prog, struct entropy *src, char *out)
+{
+    const struct ac_dfa *dfa = prog->dfa;
+
+    for (long tries = 0; tries < GEN_MAX_RESTART; ++tries) {
+        uint32_t    state = prog->dfa_start;
+        char        *p    = out;
+
+        for (size_t i = 0; i < prog->nops; ++i) {
+            const struct gen_op *op = &prog->ops[i];
+
+            for (size_t j = 0; j < op->run; ++j, ++p) {
+                if (!draw(op, src, p))
+                    return 0;
+                state = AC_STEP(dfa, state, *p);
+                if (dfa->match[state])
+                    goto restart;
+            }
+        }
+        *p = '\0';
+
+        return 1;
+restart:
+        ;
+    }
+    fprintf(stderr, "E: forbidden substrings rejected %d candidates in a row\n",
+            GEN_MAX_RESTART);
+
+    return 0;
+}
+
+/*
+ * Maps the 32 bit value x into [0, n) with a multiplication instead of a
+ * division (Lemire). The few values that would bias the result are replaced
+ * by fresh draws from the insecure source src.
+ */
+static uint32_t
+reduce_insecure(struct entropy *src, uint32_t x, uint32_t n)
+{
+    uint64_t m = (uint64_t) x * n;
+
+    if ((uint32_t) m < n) {
+        uint32_t t = (uint32_t) -n % n;
+
+        while ((uint32_t) m < t) {
+            x = (uint32_t) entropy_insecure_u64(src);
+            m = (uint64_t) x * n;
+        }
+    }
+
+    return (uint32_t) (m >> 32);
+}
+
+/*
+ * gen_run() for insecure sources. Draws go straight to the generator state
+ * rather than through the buffer, each 64 bit value yields two symbols.
+ */
+static int
+run_insecure(const struct gen_prog *prog, struct entropy *src, char *out)
+{
+    for (size_t i = 0; i < prog->nops; ++i) {
+        const struct gen_op *op    = &prog->ops[i];
+        const char          *table = op->table;
+        uint32_t            n      = (uint32_t) op->table_len;
+        size_t              j      = 0;
+
+        if (n == 1) {
+            memset(out, *table, op->run);
+        } else if (op->alias) {
+            for (; j < op->run; ++j) {
+                uint64_t r   = entropy_insecure_u64(src);
+                uint32_t col = reduce_insecure(src, (uint32_t) r, n);
+
+                out[j] = table[((uint32_t) (r >> 32) < op->alias->prob[col])
+                               ? col : op->alias->alias[col]];
+            }
+        } else {
+            for (; j + 1 < op->run; j += 2) {
+                uint64_t r = entropy_insecure_u64(src);
+
+                out[j]     = table[reduce_insecure(src, (uint32_t) r, n)];
+                out[j + 1] = table[reduce_insecure(src, (uint32_t) (r >> 32), n)];
+            }
+            if (j < op->run)
+                out[j] = table[reduce_insecure(src,
+                                   (uint32_t) entropy_insecure_u64(src), n)];
+        }
+        out += op->run;
+    }
+    *out = '\0';
+
+    return 1;
+}
+
+/**
+ * Runs prog, writing a null terminated string of prog->len symbols to out.
+ * Returns 1 on success, 0 on failure.
+ */
+int
+gen_run(const struct gen_prog *prog, struct entropy *src, char *out)
+{
+    if (prog->enc != ENC_NONE)
+        return run_key(prog, src, out);
+    if (prog->dfa)
+        return run_scanned(prog, src, out);
+    if (src->fd == -1)
+        return run_insecure(prog, src, out);
+
+    for (size_t i = 0; i < prog->nops; ++i) {
+        const struct gen_op *op    = &prog->ops[i];
+        const char          *table = op->table;
+
+        if (op->table_len == 1) {
+            memset(out, *table, op->run);
+        } else if (op->alias) {
+            for (size_t j = 0; j < op->run; ++j) {
+                size_t sym;
+
+                if (!alias_sample(op->alias, src, &sym))
+                    return 0;
+                out[j] = table[sym];
+            }
+        } else {
+            for (size_t j = 0; j < op->run; ++j) {
+                uint32_t sym;
+
+                if (!entropy_uniform(src, (uint32_t) op->table_len, &sym))
+                    return 0;
+                out[j] = table[sym];
+            }
+        }
+        out += op->run;
+    }
+    *out = '\0';
+
+    return 1;
+}
+
+static int
+gen_worker(void *ctx, long t, size_t begin, size_t end)
+{
+    const struct gen_job *job = ctx;
+
+    for (size_t i = begin; i < end; ++i) {
+        if (!gen_run(job->prog, &job->srcs[t],
+                     job->recs + i * job->rec_size + job->offset))
+            return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Runs prog for n records spaced rec_size bytes apart, each string starting
+ * offset bytes into its record. The work is spread over up to nthreads
+ * threads in contiguous slices, thread t drawing from srcs[t], so records
+ * come out in the same order for any thread count. Returns 1 on success, on
+ * failure an error is printed to stderr and 0 is returned.
+ */
+int
+gen_batch(const struct gen_prog *prog, struct entropy *srcs, char *recs,
+          size_t rec_size, size_t offset, size_t n, long nthreads)
+{
+    struct gen_job job = { prog, srcs, recs, rec_size, offset };
+
+    return run_slices(n, nthreads, gen_worker, &job);
+}
@@ -0,0 +1,51 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ac.h"
+#include "alias.h"
+#include "encode.h"
+#include "entropy.h"
+
+/*
+ * A generator program is a list of ops, each filling run consecutive
+ * positions with symbols drawn from table, according to alias if it is set
+ * and uniformly otherwise. Ops with a one symbol table are literals and
+ * consume no randomness. If dfa is set, generation starts over as soon as
+ * the string so far, including the prefix it will follow, contains a
+ * forbidden substring. Programs for binary to
+ * text keys have a single op over the encoding's alphabet and set enc; they
+ * encode random bytes directly instead of drawing symbols one by one.
+ */
+struct gen_op {
+    const char                  *table;
+    size_t                      table_len;
+    const struct alias_table    *alias;
+    size_t                      run;
+};
+
+struct gen_prog {
+    struct gen_op   *ops;
+    size_t          nops;
+    size_t          len;        // total length of a generated string
+    char            *strtab;    // storage for tables owned by the program
+    const struct ac_dfa *dfa;   // forbidden substrings, or NULL
+    uint32_t        dfa_start;  // dfa state after the prefix
+    encoding_t      enc;
+};
+
+int gen_prog_uniform(struct gen_prog *prog, const char *table,
+                     const struct alias_table *alias, size_t len);
+int gen_prog_key(struct gen_prog *prog, encoding_t enc, size_t len);
+void gen_prog_free(struct gen_prog *prog);
+int gen_prog_forbid(struct gen_prog *prog, const struct ac_dfa *dfa,
+                    const char *prefix);
+double gen_prog_entropy(const struct gen_prog *prog);
+void gen_prog_alphabet(const struct gen_prog *prog, unsigned char alphabet[256]);
+int gen_run(const struct gen_prog *prog, struct entropy *src, char *out);
+int gen_batch(const struct gen_prog *prog, struct entropy *srcs, char *recs,
+              size_t rec_size, size_t offset, size_t n, long nthreads);
+
+#endif  /* GEN_H */
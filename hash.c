@@ -0,0 +1,356 @@
+/*****************************************************************************
+ * Password hashing stage for pgen
+ *
+ * Supported schemes:
+ *
+ *   sha256-crypt   $5$[rounds=N$]salt$hash as specified by Ulrich Drepper,
+ *                  understood by glibc crypt(3)
+ *   pbkdf2-sha256  $pbkdf2-sha256$N$salt$hash, PBKDF2-HMAC-SHA256 with a
+ *                  32 byte key, salt and key in the adapted base64 of passlib
+ *
+ * Records of a batch are independent, hash_batch() splits them into one
+ * contiguous slice per thread.
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+#include "sha256.h"
+#include "slice.h"
+
+#define SHA256_CRYPT_ROUNDS_DEFAULT     5000
+#define SHA256_CRYPT_ROUNDS_MIN         1000
+#define SHA256_CRYPT_ROUNDS_MAX         999999999
+#define PBKDF2_ROUNDS_DEFAULT           29000
+#define PBKDF2_ROUNDS_MAX               0xffffffffUL
+
+static const char crypt_b64[] =
+    "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+static const char ab64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789./";
+
+struct hash_job {
+    const struct hash_opts  *opts;
+    const char              *recs;
+    size_t                  rec_size;
+    const unsigned char     *salts;
+    char                    *out;
+};
+
+/**
+ * Sets up opts for the named scheme. rounds may be 0 to select the scheme's
+ * default. Returns 1 on success, on failure an error is printed to stderr
+ * and 0 is returned.
+ */
+int
+hash_opts_init(struct hash_opts *opts, const char *scheme, long rounds)
+{
+    unsigned long min, max, def;
+
+    if (!strcmp(scheme, "sha256-crypt")) {
+        opts->scheme = HASH_SHA256_CRYPT;
+        min = SHA256_CRYPT_ROUNDS_MIN;
+        max = SHA256_CRYPT_ROUNDS_MAX;
+        def = SHA256_CRYPT_ROUNDS_DEFAULT;
+    } else if (!strcmp(scheme, "pbkdf2-sha256")) {
+        opts->scheme = HASH_PBKDF2_SHA256;
+        min = 1;
+        max = PBKDF2_ROUNDS_MAX;
+        def = PBKDF2_ROUNDS_DEFAULT;
+    } else {
+        fprintf(stderr, "E: unknown hash scheme '%s'\n", scheme);
+        return 0;
+    }
+
+    if (rounds == 0) {
+        opts->rounds = def;
+    } else if (rounds < 0 || (unsigned long) rounds < min ||
+               (unsigned long) rounds > max)
+    {
+        fprintf(stderr, "E: %s rounds must be in [%lu,%lu]\n", scheme, min, max);
+        return 0;
+    } else {
+        opts->rounds = rounds;
+    }
+
+    return 1;
+}
+
+/*
+ * Appends n base64 characters encoding the 24 bit group b2 b1 b0, least
+ * significant bits first, as crypt(3) does. Returns the new end of out.
+ */
+static char *
+b64_from_24bit(char *out, unsigned b2, unsigned b1, unsigned b0, int n)
+{
+    unsigned long w = (b2 << 16) | (b1 << 8) | b0;
+
+    while (n-- > 0) {
+        *out++ = crypt_b64[w & 0x3f];
+        w >>= 6;
+    }
+
+    return out;
+}
+
+/*
+ * sha256-crypt of pass into out. p_bytes is scratch space of at least
+ * strlen(pass) bytes for the byte sequence P, wiped before returning.
+ */
+static void
+sha256_crypt(const char *pass, const unsigned char *salt_bytes,
+             unsigned long rounds, unsigned char *p_bytes, char *out)
+{
+    struct sha256_ctx   ctx;
+    struct sha256_ctx   alt;
+    unsigned char       a[SHA256_DIGEST_LEN];
+    unsigned char       dp[SHA256_DIGEST_LEN];
+    unsigned char       ds[SHA256_DIGEST_LEN];
+    char                salt[HASH_SALT_LEN];
+    size_t              plen = strlen(pass);
+    size_t              slen = HASH_SALT_LEN;
+    size_t              cnt;
+
+    // the salt is taken from the crypt alphabet, 6 random bits per character
+    for (size_t i = 0; i < slen; ++i)
+        salt[i] = crypt_b64[salt_bytes[i] & 0x3f];
+
+    // digest B = H(pass salt pass)
+    sha256_init(&alt);
+    sha256_update(&alt, pass, plen);
+    sha256_update(&alt, salt, slen);
+    sha256_update(&alt, pass, plen);
+    sha256_final(&alt, a);
+
+    // digest A
+    sha256_init(&ctx);
+    sha256_update(&ctx, pass, plen);
+    sha256_update(&ctx, salt, slen);
+    for (cnt = plen; cnt > SHA256_DIGEST_LEN; cnt -= SHA256_DIGEST_LEN)
+        sha256_update(&ctx, a, SHA256_DIGEST_LEN);
+    sha256_update(&ctx, a, cnt);
+    for (cnt = plen; cnt > 0; cnt >>= 1) {
+        if (cnt & 1)
+            sha256_update(&ctx, a, SHA256_DIGEST_LEN);
+        else
+            sha256_update(&ctx, pass, plen);
+    }
+    sha256_final(&ctx, a);
+
+    // digest DP and byte sequence P
+    sha256_init(&alt);
+    for (cnt = 0; cnt < plen; ++cnt)
+        sha256_update(&alt, pass, plen);
+    sha256_final(&alt, dp);
+    for (cnt = 0; cnt < plen; ++cnt)
+        p_bytes[cnt] = dp[cnt % SHA256_DIGEST_LEN];
+
+    // digest DS, the salt is never longer than a digest so S is a prefix
+    sha256_init(&alt);
+    for (cnt = 0; cnt < 16u + a[0]; ++cnt)
+        sha256_update(&alt, salt, slen);
+    sha256_final(&alt, ds);
+
+    for (unsigned long i = 0; i < rounds; ++i) {
+        sha256_init(&ctx);
+        if (i & 1)
+            sha256_update(&ctx, p_bytes, plen);
+        else
+            sha256_update(&ctx, a, SHA256_DIGEST_LEN);
+        if (i % 3)
+            sha256_update(&ctx, ds, slen);
+        if (i % 7)
+            sha256_update(&ctx, p_bytes, plen);
+        if (i & 1)
+            sha256_update(&ctx, a, SHA256_DIGEST_LEN);
+        else
+            sha256_update(&ctx, p_bytes, plen);
+        sha256_final(&ctx, a);
+    }
+    memset(p_bytes, 0, plen);
+
+    if (rounds == SHA256_CRYPT_ROUNDS_DEFAULT)
+        out += sprintf(out, "$5$%.*s$", (int) slen, salt);
+    else
+        out += sprintf(out, "$5$rounds=%lu$%.*s$", rounds, (int) slen, salt);
+
+    out = b64_from_24bit(out, a[0], a[10], a[20], 4);
+    out = b64_from_24bit(out, a[21], a[1], a[11], 4);
+    out = b64_from_24bit(out, a[12], a[22], a[2], 4);
+    out = b64_from_24bit(out, a[3], a[13], a[23], 4);
+    out = b64_from_24bit(out, a[24], a[4], a[14], 4);
+    out = b64_from_24bit(out, a[15], a[25], a[5], 4);
+    out = b64_from_24bit(out, a[6], a[16], a[26], 4);
+    out = b64_from_24bit(out, a[27], a[7], a[17], 4);
+    out = b64_from_24bit(out, a[18], a[28], a[8], 4);
+    out = b64_from_24bit(out, a[9], a[19], a[29], 4);
+    out = b64_from_24bit(out, 0, a[31], a[30], 3);
+    *out = '\0';
+}
+
+/*
+ * Encodes n bytes as unpadded base64 with '.' in place of '+'. Returns the
+ * new end of out.
+ */
+static char *
+ab64_encode(char *out, const unsigned char *in, size_t n)
+{
+    for (; n >= 3; in += 3, n -= 3) {
+        *out++ = ab64[in[0] >> 2];
+        *out++ = ab64[(in[0] & 0x03) << 4 | in[1] >> 4];
+        *out++ = ab64[(in[1] & 0x0f) << 2 | in[2] >> 6];
+        *out++ = ab64[in[2] & 0x3f];
+    }
+    if (n) {
+        *out++ = ab64[in[0] >> 2];
+        if (n == 1) {
+            *out++ = ab64[(in[0] & 0x03) << 4];
+        } else {
+            *out++ = ab64[(in[0] & 0x03) << 4 | in[1] >> 4];
+            *out++ = ab64[(in[1] & 0x0f) << 2];
+        }
+    }
+
+    return out;
+}
+
+static void
+pbkdf2_sha256(const char *pass, const unsigned char *salt,
+              unsigned long rounds, char *out)
+{
+    struct sha256_ctx   inner;
+    struct sha256_ctx   outer;
+    struct sha256_ctx   ctx;
+    unsigned char       key[SHA256_BLOCK_LEN];
+    unsigned char       u[SHA256_DIGEST_LEN];
+    unsigned char       t[SHA256_DIGEST_LEN];
+    static const unsigned char block_index[4] = { 0, 0, 0, 1 };
+    size_t              plen = strlen(pass);
+
+    // HMAC key schedule, done once and copied for every round
+    memset(key, 0, sizeof key);
+    if (plen > SHA256_BLOCK_LEN)
+        sha256(pass, plen, key);
+    else
+        memcpy(key, pass, plen);
+
+    for (int i = 0; i < SHA256_BLOCK_LEN; ++i)
+        key[i] ^= 0x36;
+    sha256_init(&inner);
+    sha256_update(&inner, key, SHA256_BLOCK_LEN);
+    for (int i = 0; i < SHA256_BLOCK_LEN; ++i)
+        key[i] ^= 0x36 ^ 0x5c;
+    sha256_init(&outer);
+    sha256_update(&outer, key, SHA256_BLOCK_LEN);
+    memset(key, 0, sizeof key);
+
+    // a 32 byte key is exactly one block, U1 = HMAC(salt || INT(1))
+    ctx = inner;
+    sha256_update(&ctx, salt, HASH_SALT_LEN);
+    sha256_update(&ctx, block_index, sizeof block_index);
+    sha256_final(&ctx, u);
+    ctx = outer;
+    sha256_update(&ctx, u, SHA256_DIGEST_LEN);
+    sha256_final(&ctx, u);
+    memcpy(t, u, SHA256_DIGEST_LEN);
+
+    for (unsigned long i = 1; i < rounds; ++i) {
+        ctx = inner;
+        sha256_update(&ctx, u, SHA256_DIGEST_LEN);
+        sha256_final(&ctx, u);
+        ctx = outer;
+        sha256_update(&ctx, u, SHA256_DIGEST_LEN);
+        sha256_final(&ctx, u);
+        for (int j = 0; j < SHA256_DIGEST_LEN; ++j)
+            t[j] ^= u[j];
+    }
+
+    out += sprintf(out, "$pbkdf2-sha256$%lu$", rounds);
+    out = ab64_encode(out, salt, HASH_SALT_LEN);
+    *out++ = '$';
+    out = ab64_encode(out, t, SHA256_DIGEST_LEN);
+    *out = '\0';
+}
+
+/*
+ * hash_record() with caller provided scratch space of at least strlen(pass)
+ * bytes, so hashing itself cannot fail
+ */
+static void
+hash_scratch(const struct hash_opts *opts, const char *pass,
+             const unsigned char *salt, unsigned char *scratch, char *out)
+{
+    switch (opts->scheme) {
+    case HASH_SHA256_CRYPT:
+        sha256_crypt(pass, salt, opts->rounds, scratch, out);
+        break;
+    case HASH_PBKDF2_SHA256:
+        pbkdf2_sha256(pass, salt, opts->rounds, out);
+        break;
+    default:
+        *out = '\0';
+        break;
+    }
+}
+
+/**
+ * Hashes pass with HASH_SALT_LEN random bytes of salt, writing the encoded
+ * hash to out, which must hold HASH_MAX_LEN characters. Returns 1 on
+ * success, on failure an error is printed to stderr and 0 is returned.
+ */
+int
+hash_record(const struct hash_opts *opts, const char *pass,
+            const unsigned char *salt, char *out)
+{
+    size_t          plen = strlen(pass);
+    unsigned char   *scratch;
+
+    if (!(scratch = malloc(plen ? plen : 1))) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        return 0;
+    }
+    hash_scratch(opts, pass, salt, scratch, out);
+    free(scratch);
+
+    return 1;
+}
+
+static int
+hash_worker(void *ctx, long t, size_t begin, size_t end)
+{
+    const struct hash_job   *job = ctx;
+    unsigned char           *scratch;
+
+    (void) t;
+    // records are shorter than rec_size, one scratch buffer serves them all
+    if (!(scratch = malloc(job->rec_size))) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        return 0;
+    }
+    for (size_t i = begin; i < end; ++i)
+        hash_scratch(job->opts, job->recs + i * job->rec_size,
+                     job->salts + i * HASH_SALT_LEN, scratch,
+                     job->out + i * HASH_MAX_LEN);
+    free(scratch);
+
+    return 1;
+}
+
+/**
+ * Hashes n null terminated records spaced rec_size bytes apart, using
+ * HASH_SALT_LEN bytes of salts per record, into out at HASH_MAX_LEN byte
+ * intervals. The work is spread over up to nthreads threads. Returns 1 on
+ * success, on failure an error is printed to stderr and 0 is returned.
+ */
+int
+hash_batch(const struct hash_opts *opts, const char *recs, size_t rec_size,
+           const unsigned char *salts, char *out, size_t n, long nthreads)
+{
+    struct hash_job job = { opts, recs, rec_size, salts, out };
+
+    return run_slices(n, nthreads, hash_worker, &job);
+}
@@ -0,0 +1,27 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stddef.h>
+
+#define HASH_SALT_LEN   16      // random bytes drawn per record
+#define HASH_MAX_LEN    128     // longest encoded hash plus terminator
+
+typedef enum {
+    HASH_NONE,
+    HASH_SHA256_CRYPT,
+    HASH_PBKDF2_SHA256,
+} hash_scheme_t;
+
+struct hash_opts {
+    hash_scheme_t   scheme;
+    unsigned long   rounds;
+};
+
+int hash_opts_init(struct hash_opts *opts, const char *scheme, long rounds);
+int hash_record(const struct hash_opts *opts, const char *pass,
+                const unsigned char *salt, char *out);
+int hash_batch(const struct hash_opts *opts, const char *recs,
+               size_t rec_size, const unsigned char *salts, char *out,
+               size_t n, long nthreads);
+
+#endif  /* HASH_H */
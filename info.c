@@ -33,9 +33,73 @@
     "   -e      excludes any characters in the string given as argument\n"                  \
     "   -i      specifies additional characters to include in character set\n"              \
     "\n"                                                                                    \
-    "   -d      dump symbol table\n"                                                        \
+    "   -s      reject passwords containing any of the substrings listed in the given\n"   \
+    "           file, one per line, ignoring case. May be given more than once\n"          \
+    "\n"                                                                                    \
+    "   -w      weight symbols, given as a list of key=weight items separated by\n"         \
+    "           commas. A key is a single symbol, or one of the classes lower,\n"           \
+    "           upper, digit and punct. Symbols not named default to weight 1.\n"           \
+    "           The comma is weighted like any other symbol, e.g. -w ',=0.1'\n"              \
+    "   -W      read symbol weights from the given file, one key=weight per line.\n"        \
+    "           Items given with -w are applied after the file\n"                          \
+    "\n"                                                                                    \
+    "   -t      generate passwords matching the given pattern, which also sets the\n"       \
+    "           length. Pattern items are (see: Pattern items):\n"                         \
+    "\n"
+
+#define MORE_OPTIONS_INFO                                                                      \
+    "   -H      hash each password with the given scheme and output records of the\n"      \
+    "           form password<TAB>hash. Schemes are sha256-crypt ($5$, as used by\n"       \
+    "           crypt(3)) and pbkdf2-sha256 ($pbkdf2-sha256$, passlib format).\n"          \
+    "           Each record gets a random salt from the pseudorandom source\n"             \
+    "   -R      hash rounds (default: 5000 for sha256-crypt, 29000 for pbkdf2-sha256)\n"   \
+    "   -T      number of threads for hashing, -X and -E, at most 1024 (default:\n"        \
+    "           online processors)\n"                                                      \
+    "   -x      output the hash only, without the password\n"                              \
+    "\n"                                                                                    \
+    "   -k      generate random keys in the given encoding instead of passwords:\n"      \
+    "           hex, base32, base64, base64url or base58. The character set options\n"    \
+    "           do not apply, -p and -l do\n"                                              \
+    "   -b      key strength in bits (default: 128), sets the key length unless -l is\n"  \
+    "           given\n"                                                                   \
+    "\n"                                                                                    \
+    "   -a      assign a password to each identifier read from standard input, one\n"   \
+    "           per line, and output records of the form identifier<TAB>password,\n"     \
+    "           followed by <TAB>hash when hashing. Empty lines are skipped\n"            \
+    "   -A      field separator for -a output (default: TAB)\n"                          \
+    "\n"                                                                                    \
+    "   -S      run as producer of the shared memory password pool of the given name\n"    \
+    "           (e.g. /pgen), keeping it filled with passwords generated according\n"      \
+    "           to the other options until terminated. The pool holds 256 passwords\n"     \
+    "           unless a count is given with -c, and is topped up once a quarter\n"        \
+    "           of it is left\n"                                                            \
+    "   -G      take one password from the shared memory pool of the given name and\n"     \
+    "           exit. Fails if the pool is empty\n"                                        \
+    "\n"                                                                                    \
+    "   -X      INSECURE: use a fast non-cryptographic generator (xoshiro256**),\n"     \
+    "           spread over -T threads, to produce bulk test data. The output is\n"       \
+    "           predictable and must never be used as credentials, so -X refuses\n"       \
+    "           -H, -F, -B, -k, -a, -S and -G\n"                                            \
+    "\n"                                                                                    \
+    "   -E      enumerate the keyspace, all passwords the other options can\n"          \
+    "           produce, in order from the given index on. Passwords are numbered\n"      \
+    "           with the last position counting fastest, through each position's\n"      \
+    "           symbols in symbol table order. Stops after -c passwords if given\n"       \
+    "   -r      print the keyspace index of the given password\n"                          \
+    "\n"                                                                                    \
+    "   -d      dump symbol table and entropy per symbol and per password, and the\n"    \
+    "           keyspace size with -E or -r\n"                                              \
+    "   -v      report statistics of the continuous health tests (SP 800-90B\n"        \
+    "           repetition count and adaptive proportion) run on all bytes read\n"      \
+    "           from the pseudorandom source to stderr once done. A failing test\n"     \
+    "           always stops generation with an error\n"                                 \
     "   -C      enable colorful text output\n"                                              \
     "\n"                                                                                    \
+    "   -F      reject and regenerate any password found in the given denylist\n"           \
+    "           filter file. A filter is compiled from a plain text list with -B\n"         \
+    "   -B      build the filter file given by -F from the list given as argument,\n"       \
+    "           one entry per line, then exit\n"                                            \
+    "\n"                                                                                    \
     "Without specifying any options, default parameters will be used\n"                     \
     "Default parameters are fast character mode 3 and a length of 6, equivalent to\n"       \
     "%s -f3 -l6. Default behavior can be overridden by specifying the desired options\n"    \
@@ -49,6 +113,17 @@
     "       is specified, the result will be the use of all printable non-whitespace\n"     \
     "       ASCII characters. equivalent  -LUDP\n"                                          \
 
+#define PATTERN_INFO                                                                        \
+    "-t Pattern items: \n"                                                                  \
+    "   l   lowercase letter            L   uppercase letter\n"                             \
+    "   d   digit                       p   punctuation character\n"                        \
+    "   a   any letter                  n   letter or digit\n"                              \
+    "   *   any symbol from the symbol table selected by the other options,\n"              \
+    "       drawn according to -w/-W weights if given\n"                                    \
+    "   [abc]   any one of the characters between brackets\n"                               \
+    "   \\c  the character c             {n} repeat the preceding item n times\n"           \
+    "   Any other character stands for itself. Class items honour the -e list\n"            \
+
 #define EXAMPLE_INFO                                                                        \
     "Examples:\n"                                                                           \
     "   %s -f1 -l42\tProduce a password of length 42 using only\n"                          \
@@ -67,17 +142,72 @@
     "\t\t\te.g. 4idFiV\n"                                                                   \
     "\n"                                                                                    \
     "   %s -l8 -N -i01\tProduces 8 character password consisting of 1 and 0 only\n"         \
-    "\t\t\te.g. 10101100\n"
+    "\t\t\te.g. 10101100\n"                                                                \
+    "\n"                                                                                    \
+    "   %s -t 'Llll-d{4}-LLLL'\n"                                                          \
+    "\t\t\tProduce a password such as Qvxe-0931-MZTA\n"                                    \
+    "\n"                                                                                    \
+    "   %s -t 'a*{11}'\tProduce a 12 character password starting with a letter\n"           \
+    "\n"                                                                                    \
+    "   %s -f4 -w punct=0.2 -d\n"                                                          \
+    "\t\t\tMake punctuation five times rarer than other symbols and\n"                   \
+    "\t\t\treport the resulting entropy\n"                                                 \
+    "\n"                                                                                    \
+    "   %s -k base64url -b 256\n"                                                        \
+    "\t\t\tProduce a 256 bit key, e.g. for use as an API token\n"                        \
+    "\n"                                                                                    \
+    "   %s -l16 -c1000 -H pbkdf2-sha256\n"                                                 \
+    "\t\t\tProduce 1000 passwords, each followed by its PBKDF2 hash\n"                     \
+    "\n"                                                                                    \
+    "   %s -a -l16 -H sha256-crypt < users.txt\n"                                       \
+    "\t\t\tProduce a password and its hash for each user name in\n"                     \
+    "\t\t\tusers.txt, e.g. alice\tXk2v...\t$5$...\n"                                   \
+    "\n"                                                                                    \
+    "   %s -X -f4 -l12 -c100000000 > fixture.txt\n"                                    \
+    "\t\t\tProduce a large test data set quickly, not for real use\n"                   \
+    "\n"                                                                                    \
+    "   %s -L -l6 -E0 -T4\tList every 6 letter lowercase password, aaaaaa to\n"     \
+    "\t\t\tzzzzzz, using 4 threads\n"                                                      \
+    "\n"                                                                                    \
+    "   %s -S /pgen -l20 &\n"                                                             \
+    "   %s -G /pgen\tKeep a pool of 20 character passwords in shared memory\n"              \
+    "\t\t\tand take one from it\n"                                                         \
+    "\n"                                                                                    \
+    "   %s -l12 -s words.txt -s <(echo \"$USER\")\n"                                      \
+    "\t\t\tProduce a password containing no word from words.txt and\n"                     \
+    "\t\t\tnot the user name\n"                                                            \
+    "\n"                                                                                    \
+    "   %s -B leaked.txt -F leaked.pgf\n"                                                   \
+    "\t\t\tCompile the list leaked.txt into filter file leaked.pgf\n"                      \
+    "\n"                                                                                    \
+    "   %s -l16 -c100 -F leaked.pgf\n"                                                      \
+    "\t\t\tProduce 100 passwords, none of which appear in leaked.txt\n"
 
 void show_info(const char *fname)
 {
     printf(INFO_HEAD, fname);
     fputc('\n', stdout);
-    printf(OPTIONS_INFO, fname);
+    printf(OPTIONS_INFO);
+    printf(MORE_OPTIONS_INFO, fname);
     fputc('\n', stdout);
     printf(MODE_INFO);
     fputc('\n', stdout);
+    printf(PATTERN_INFO);
+    fputc('\n', stdout);
     printf(EXAMPLE_INFO, fname
+                       , fname
+                       , fname
+                       , fname
+                       , fname
+                       , fname
+                       , fname
+                       , fname
+                       , fname
+                       , fname
+                       , fname
+                       , fname
+                       , fname
+                       , fname
                        , fname
                        , fname
                        , fname
@@ -0,0 +1,412 @@
+/*****************************************************************************
+ * Keyspace enumeration for pgen
+ *
+ * Maps indices to the strings a generator program can produce and back, so
+ * that a keyspace can be walked exhaustively or audited at chosen points.
+ * Ranges are split into one contiguous slice per thread. Each slice unranks
+ * its first index once and then counts up like an odometer, so a string
+ * costs a copy of the previous one and, on average, a single symbol update.
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "keyspace.h"
+#include "slice.h"
+
+struct keyspace_job {
+    const struct keyspace   *ks;
+    const uint32_t          *start;
+    char                    *recs;
+    size_t                  rec_size;
+    size_t                  offset;
+};
+
+/*
+ * x = x * m + a over n limbs, returns the carry out of the top limb
+ */
+static uint32_t
+mul_add(uint32_t *x, size_t n, uint32_t m, uint32_t a)
+{
+    uint64_t carry = a;
+
+    for (size_t i = 0; i < n; ++i) {
+        carry += (uint64_t) x[i] * m;
+        x[i]   = (uint32_t) carry;
+        carry >>= 32;
+    }
+
+    return (uint32_t) carry;
+}
+
+/*
+ * x = x / d over n limbs, returns the remainder
+ */
+static uint32_t
+div_small(uint32_t *x, size_t n, uint32_t d)
+{
+    uint64_t rem = 0;
+
+    while (n--) {
+        rem   = (rem << 32) | x[n];
+        x[n]  = (uint32_t) (rem / d);
+        rem  %= d;
+    }
+
+    return (uint32_t) rem;
+}
+
+static int
+cmp_limbs(const uint32_t *a, const uint32_t *b, size_t n)
+{
+    while (n--)
+        if (a[n] != b[n])
+            return (a[n] > b[n]) - (a[n] < b[n]);
+
+    return 0;
+}
+
+static int
+is_zero(const uint32_t *x, size_t n)
+{
+    while (n--)
+        if (x[n])
+            return 0;
+
+    return 1;
+}
+
+static uint64_t
+to_u64(const uint32_t *x, size_t n)
+{
+    return n > 1 ? (uint64_t) x[1] << 32 | x[0] : x[0];
+}
+
+static void
+from_u64(uint32_t *x, size_t n, uint64_t v)
+{
+    x[0] = (uint32_t) v;
+    if (n > 1)
+        x[1] = (uint32_t) (v >> 32);
+}
+
+/**
+ * Sets up ks for the strings prog produces, prog must not be a key
+ * encoding program. ks references prog's tables. Returns 1 on success, on
+ * failure an error is printed to stderr and 0 is returned.
+ */
+int
+keyspace_init(struct keyspace *ks, const struct gen_prog *prog)
+{
+    size_t  pos  = 0;
+    size_t  bits = 0;
+
+    memset(ks, 0, sizeof(struct keyspace));
+    ks->len   = prog->len;
+    ks->table = malloc((prog->len ? prog->len : 1) * sizeof(const char *));
+    ks->radix = malloc((prog->len ? prog->len : 1) * sizeof(uint32_t));
+    if (!ks->table || !ks->radix) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        keyspace_free(ks);
+        return 0;
+    }
+
+    for (size_t i = 0; i < prog->nops; ++i) {
+        for (size_t j = 0; j < prog->ops[i].run; ++j, ++pos) {
+            ks->table[pos] = prog->ops[i].table;
+            ks->radix[pos] = (uint32_t) prog->ops[i].table_len;
+            for (uint32_t r = ks->radix[pos] - 1; r; r >>= 1)
+                ++bits;
+        }
+    }
+
+    // bits bounds the size from above, trim the limbs it did not need
+    ks->nlimbs = bits / 32 + 1;
+    if (!(ks->size = calloc(ks->nlimbs, sizeof(uint32_t)))) {
+        fprintf(stderr, "E: failed to allocate memory (calloc)\n");
+        keyspace_free(ks);
+        return 0;
+    }
+    ks->size[0] = 1;
+    for (pos = 0; pos < ks->len; ++pos)
+        mul_add(ks->size, ks->nlimbs, ks->radix[pos], 0);
+    while (ks->nlimbs > 1 && !ks->size[ks->nlimbs - 1])
+        --ks->nlimbs;
+
+    return 1;
+}
+
+void
+keyspace_free(struct keyspace *ks)
+{
+    free(ks->table);
+    free(ks->radix);
+    free(ks->size);
+    memset(ks, 0, sizeof(struct keyspace));
+}
+
+/**
+ * Allocates a zero index for ks, to be freed by the caller. On failure an
+ * error is printed to stderr and NULL is returned.
+ */
+uint32_t *
+keyspace_index(const struct keyspace *ks)
+{
+    uint32_t *idx = calloc(ks->nlimbs, sizeof(uint32_t));
+
+    if (!idx)
+        fprintf(stderr, "E: failed to allocate memory (calloc)\n");
+
+    return idx;
+}
+
+/**
+ * Parses the decimal index s into idx. Returns 1 on success, on failure an
+ * error is printed to stderr and 0 is returned.
+ */
+int
+keyspace_parse(const struct keyspace *ks, const char *s, uint32_t *idx)
+{
+    memset(idx, 0, ks->nlimbs * sizeof(uint32_t));
+
+    if (!*s) {
+        fprintf(stderr, "E: bad index ''\n");
+        return 0;
+    }
+    for (const char *p = s; *p; ++p) {
+        if (*p < '0' || *p > '9') {
+            fprintf(stderr, "E: bad index '%s'\n", s);
+            return 0;
+        }
+        if (mul_add(idx, ks->nlimbs, 10, *p - '0'))
+            break;
+        if (cmp_limbs(idx, ks->size, ks->nlimbs) >= 0)
+            break;
+        if (!p[1])
+            return 1;
+    }
+    fprintf(stderr, "E: index '%s' is outside the keyspace\n", s);
+
+    return 0;
+}
+
+/**
+ * Formats idx in decimal. Returns the string, which must be freed by the
+ * caller, on failure an error is printed to stderr and NULL is returned.
+ */
+char *
+keyspace_format(const struct keyspace *ks, const uint32_t *idx)
+{
+    uint32_t    *x;
+    char        *s;
+    size_t      n = 0;
+
+    x = malloc(ks->nlimbs * sizeof(uint32_t));
+    s = malloc(ks->nlimbs * 10 + 1);
+    if (!x || !s) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        free(x);
+        free(s);
+        return NULL;
+    }
+    memcpy(x, idx, ks->nlimbs * sizeof(uint32_t));
+
+    // digits come out least significant first
+    do {
+        s[n++] = '0' + div_small(x, ks->nlimbs, 10);
+    } while (!is_zero(x, ks->nlimbs));
+    for (size_t i = 0; i < n / 2; ++i) {
+        char c = s[i];
+
+        s[i]         = s[n - 1 - i];
+        s[n - 1 - i] = c;
+    }
+    s[n] = '\0';
+
+    free(x);
+    return s;
+}
+
+/**
+ * Returns the number of indices from idx to the end of the keyspace,
+ * UINT64_MAX if that does not fit in 64 bits
+ */
+uint64_t
+keyspace_left(const struct keyspace *ks, const uint32_t *idx)
+{
+    uint64_t    left   = 0;
+    int64_t     borrow = 0;
+
+    for (size_t i = 0; i < ks->nlimbs; ++i) {
+        int64_t d = (int64_t) ks->size[i] - idx[i] - borrow;
+
+        borrow = d < 0;
+        if (borrow)
+            d += INT64_C(1) << 32;
+        if (i < 2)
+            left |= (uint64_t) d << (32 * i);
+        else if (d)
+            return UINT64_MAX;
+    }
+
+    return left;
+}
+
+/**
+ * Adds n to idx, the result must not lie past the end of the keyspace
+ */
+void
+keyspace_advance(const struct keyspace *ks, uint32_t *idx, uint64_t n)
+{
+    uint64_t carry = n;
+
+    for (size_t i = 0; i < ks->nlimbs && carry; ++i) {
+        carry += idx[i];
+        idx[i] = (uint32_t) carry;
+        carry >>= 32;
+    }
+}
+
+/**
+ * Stores the index of the string s in idx. Returns 1 on success, on failure
+ * an error is printed to stderr and 0 is returned.
+ */
+int
+keyspace_rank(const struct keyspace *ks, const char *s, uint32_t *idx)
+{
+    uint64_t v = 0;
+
+    memset(idx, 0, ks->nlimbs * sizeof(uint32_t));
+
+    if (strlen(s) != ks->len)
+        goto bad;
+    for (size_t pos = 0; pos < ks->len; ++pos) {
+        const char  *sym = memchr(ks->table[pos], s[pos], ks->radix[pos]);
+        uint32_t    digit;
+
+        if (!sym)
+            goto bad;
+        digit = (uint32_t) (sym - ks->table[pos]);
+        if (ks->nlimbs <= 2)
+            v = v * ks->radix[pos] + digit;
+        else
+            mul_add(idx, ks->nlimbs, ks->radix[pos], digit);
+    }
+    if (ks->nlimbs <= 2)
+        from_u64(idx, ks->nlimbs, v);
+
+    return 1;
+
+bad:
+    fprintf(stderr, "E: '%s' is not in the keyspace\n", s);
+    return 0;
+}
+
+/**
+ * Writes the null terminated string with index idx to out, and the digit
+ * of each position to digits. Returns 1 on success, on failure an error is
+ * printed to stderr and 0 is returned.
+ */
+int
+keyspace_unrank(const struct keyspace *ks, const uint32_t *idx,
+                uint32_t *digits, char *out)
+{
+    size_t pos = ks->len;
+
+    if (ks->nlimbs <= 2) {
+        uint64_t v = to_u64(idx, ks->nlimbs);
+
+        while (pos--) {
+            digits[pos] = (uint32_t) (v % ks->radix[pos]);
+            v /= ks->radix[pos];
+        }
+    } else {
+        uint32_t *x = malloc(ks->nlimbs * sizeof(uint32_t));
+
+        if (!x) {
+            fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+            return 0;
+        }
+        memcpy(x, idx, ks->nlimbs * sizeof(uint32_t));
+        while (pos--)
+            digits[pos] = div_small(x, ks->nlimbs, ks->radix[pos]);
+        free(x);
+    }
+
+    for (pos = 0; pos < ks->len; ++pos)
+        out[pos] = ks->table[pos][digits[pos]];
+    out[ks->len] = '\0';
+
+    return 1;
+}
+
+static int
+keyspace_worker(void *ctx, long t, size_t begin, size_t end)
+{
+    const struct keyspace_job   *job = ctx;
+    const struct keyspace       *ks  = job->ks;
+    uint32_t                    *idx;
+    uint32_t                    *digits;
+    char                        *prev;
+    int                         ret  = 0;
+
+    (void) t;
+    if (begin == end)
+        return 1;
+
+    idx    = keyspace_index(ks);
+    digits = malloc((ks->len ? ks->len : 1) * sizeof(uint32_t));
+    if (!idx || !digits) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        goto done;
+    }
+    memcpy(idx, job->start, ks->nlimbs * sizeof(uint32_t));
+    keyspace_advance(ks, idx, begin);
+
+    prev = job->recs + begin * job->rec_size + job->offset;
+    if (!keyspace_unrank(ks, idx, digits, prev))
+        goto done;
+
+    // count up from there, carrying into the positions to the left
+    for (size_t i = begin + 1; i < end; ++i) {
+        char    *rec = job->recs + i * job->rec_size + job->offset;
+        size_t  pos  = ks->len;
+
+        memcpy(rec, prev, ks->len + 1);
+        while (pos--) {
+            if (++digits[pos] < ks->radix[pos]) {
+                rec[pos] = ks->table[pos][digits[pos]];
+                break;
+            }
+            digits[pos] = 0;
+            rec[pos]    = ks->table[pos][0];
+        }
+        prev = rec;
+    }
+    ret = 1;
+
+done:
+    free(idx);
+    free(digits);
+    return ret;
+}
+
+/**
+ * Writes the n strings from index start on to records spaced rec_size bytes
+ * apart, each string starting offset bytes into its record. start + n must
+ * not lie past the end of the keyspace. The range is split into contiguous
+ * slices over up to nthreads threads. Returns 1 on success, on failure an
+ * error is printed to stderr and 0 is returned.
+ */
+int
+keyspace_enumerate(const struct keyspace *ks, const uint32_t *start,
+                   char *recs, size_t rec_size, size_t offset, size_t n,
+                   long nthreads)
+{
+    struct keyspace_job job = { ks, start, recs, rec_size, offset };
+
+    return run_slices(n, nthreads, keyspace_worker, &job);
+}
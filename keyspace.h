@@ -0,0 +1,39 @@
+#ifndef KEYSPACE_H
+#define KEYSPACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gen.h"
+
+/*
+ * The keyspace of a generator program: every string it can produce,
+ * numbered in mixed radix over the positions' tables with the last position
+ * varying fastest. Indices are unsigned integers of nlimbs 32 bit limbs,
+ * least significant first, just wide enough for the number of strings in
+ * size. Keyspaces of up to 64 bits (nlimbs <= 2) are ranked and unranked
+ * with native arithmetic.
+ */
+struct keyspace {
+    size_t      len;
+    const char  **table;        // table of each position
+    uint32_t    *radix;         // table length of each position
+    size_t      nlimbs;
+    uint32_t    *size;
+};
+
+int keyspace_init(struct keyspace *ks, const struct gen_prog *prog);
+void keyspace_free(struct keyspace *ks);
+uint32_t *keyspace_index(const struct keyspace *ks);
+int keyspace_parse(const struct keyspace *ks, const char *s, uint32_t *idx);
+char *keyspace_format(const struct keyspace *ks, const uint32_t *idx);
+uint64_t keyspace_left(const struct keyspace *ks, const uint32_t *idx);
+void keyspace_advance(const struct keyspace *ks, uint32_t *idx, uint64_t n);
+int keyspace_rank(const struct keyspace *ks, const char *s, uint32_t *idx);
+int keyspace_unrank(const struct keyspace *ks, const uint32_t *idx,
+                    uint32_t *digits, char *out);
+int keyspace_enumerate(const struct keyspace *ks, const uint32_t *start,
+                       char *recs, size_t rec_size, size_t offset, size_t n,
+                       long nthreads);
+
+#endif  /* KEYSPACE_H */
@@ -0,0 +1,242 @@
+/*****************************************************************************
+ * Bulk line input and record output for pgen
+ *
+ * Used to assign passwords to a list of identifiers: the identifiers are
+ * read in large blocks, or mapped if the input is a regular file, and each
+ * output record is assembled once in a large buffer that goes straight to
+ * write(2) without another copy through stdio.
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "lineio.h"
+
+/*
+ * Reads the next block of input behind end. Space is made by moving the
+ * unread tail to the front if no lines are held, and by growing the buffer
+ * otherwise. Returns 1 on success, on failure an error is printed to stderr
+ * and 0 is returned.
+ */
+static int
+fill(struct line_reader *r)
+{
+    ssize_t n;
+
+    if (r->start == r->pos && r->start) {
+        memmove(r->buf, r->buf + r->pos, r->end - r->pos);
+        r->end  -= r->pos;
+        r->start = r->pos = 0;
+    }
+    if (r->end == r->size) {
+        char *buf;
+
+        if (r->size > SIZE_MAX / 2 || !(buf = realloc(r->buf, 2 * r->size))) {
+            fprintf(stderr, "E: failed to allocate memory (realloc)\n");
+            return 0;
+        }
+        r->buf   = buf;
+        r->size *= 2;
+    }
+
+    if ((n = read(r->fd, r->buf + r->end, r->size - r->end)) == -1) {
+        perror("read");
+        return 0;
+    }
+    if (n == 0)
+        r->eof = 1;
+    r->end += n;
+
+    return 1;
+}
+
+/**
+ * Sets up a reader for fd, starting at its current offset. The descriptor
+ * is not closed by line_reader_close. Returns 1 on success, on failure an
+ * error is printed to stderr and 0 is returned.
+ */
+int
+line_reader_open(struct line_reader *r, int fd)
+{
+    struct stat st;
+    off_t       off;
+
+    memset(r, 0, sizeof(struct line_reader));
+    r->fd = fd;
+
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        return 0;
+    }
+
+    // map regular files whole, the offset need not be page aligned this way
+    if (S_ISREG(st.st_mode) && st.st_size > 0 &&
+        (off = lseek(fd, 0, SEEK_CUR)) != -1)
+    {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (map == MAP_FAILED) {
+            perror("mmap");
+            return 0;
+        }
+        r->mapped = 1;
+        r->eof    = 1;
+        r->buf    = map;
+        r->size   = r->end = st.st_size;
+        r->start  = r->pos = (off < st.st_size) ? (size_t) off : r->end;
+
+        return 1;
+    }
+
+    if (!(r->buf = malloc(LINEIO_BUF_SIZE))) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        return 0;
+    }
+    r->size = LINEIO_BUF_SIZE;
+
+    return 1;
+}
+
+void
+line_reader_close(struct line_reader *r)
+{
+    if (r->mapped)
+        munmap(r->buf, r->size);
+    else
+        free(r->buf);
+    memset(r, 0, sizeof(struct line_reader));
+}
+
+/**
+ * Stores the position of the next non-empty line in line, without its line
+ * terminator. Returns 1 if a line was found, 0 at the end of input or on
+ * failure, in which case an error is printed to stderr and r->err is set.
+ */
+int
+line_reader_next(struct line_reader *r, struct line_span *line)
+{
+    for (;;) {
+        char    *eol = NULL;
+        size_t  len;
+
+        if (r->pos < r->end)
+            eol = memchr(r->buf + r->pos, '\n', r->end - r->pos);
+        if (!eol && !r->eof) {
+            if (!fill(r)) {
+                r->err = 1;
+                return 0;
+            }
+            continue;
+        }
+        if (r->pos == r->end)
+            return 0;
+
+        len       = (eol ? (size_t) (eol - r->buf) : r->end) - r->pos;
+        line->off = r->pos;
+        r->pos   += len + (eol != NULL);
+
+        if (len && r->buf[line->off + len - 1] == '\r')
+            --len;
+        if (len) {
+            line->len = len;
+            return 1;
+        }
+    }
+}
+
+/**
+ * Releases all lines handed out so far, their offsets become invalid
+ */
+void
+line_reader_release(struct line_reader *r)
+{
+    r->start = r->pos;
+}
+
+/**
+ * Sets up an output buffer of size bytes for fd. Returns 1 on success, on
+ * failure an error is printed to stderr and 0 is returned.
+ */
+int
+out_buf_init(struct out_buf *out, int fd, size_t size)
+{
+    out->fd   = fd;
+    out->len  = 0;
+    out->size = size;
+    if (!(out->buf = malloc(size))) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Wipes and frees the buffer, anything not flushed is lost
+ */
+void
+out_buf_free(struct out_buf *out)
+{
+    if (out->buf)
+        memset(out->buf, 0, out->size);
+    free(out->buf);
+    memset(out, 0, sizeof(struct out_buf));
+}
+
+/**
+ * Makes room for n more bytes, flushing the buffer if needed. Returns where
+ * the bytes go, the caller writes them and adds n to out->len. On failure an
+ * error is printed to stderr and NULL is returned.
+ */
+char *
+out_buf_reserve(struct out_buf *out, size_t n)
+{
+    if (out->size - out->len < n) {
+        if (!out_buf_flush(out))
+            return NULL;
+        if (out->size < n) {
+            // contents are flushed, wipe them rather than leave them to realloc
+            memset(out->buf, 0, out->size);
+            free(out->buf);
+            out->size = 0;
+            if (!(out->buf = malloc(n))) {
+                fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+                return NULL;
+            }
+            out->size = n;
+        }
+    }
+
+    return out->buf + out->len;
+}
+
+/**
+ * Writes out the buffered bytes. Returns 1 on success, on failure an error
+ * is printed to stderr and 0 is returned.
+ */
+int
+out_buf_flush(struct out_buf *out)
+{
+    size_t done = 0;
+
+    while (done < out->len) {
+        ssize_t n = write(out->fd, out->buf + done, out->len - done);
+
+        if (n == -1) {
+            perror("write");
+            return 0;
+        }
+        done += n;
+    }
+    out->len = 0;
+
+    return 1;
+}
@@ -0,0 +1,52 @@
+#ifndef LINEIO_H
+#define LINEIO_H
+
+#include <stddef.h>
+
+#define LINEIO_BUF_SIZE     (1 << 20)
+
+/*
+ * Line reader over a file descriptor. Regular files are mapped whole,
+ * anything else is read in blocks of LINEIO_BUF_SIZE. Lines are handed out
+ * as offsets into buf and stay valid until line_reader_release, so a batch
+ * of lines can be read before any of them are used.
+ */
+struct line_reader {
+    int     fd;
+    int     mapped;
+    int     eof;
+    int     err;
+    char    *buf;
+    size_t  size;
+    size_t  start;                  // first byte of the unreleased lines
+    size_t  pos;
+    size_t  end;
+};
+
+struct line_span {
+    size_t  off;
+    size_t  len;
+};
+
+/*
+ * Output buffer flushed with write(2), records are assembled in place
+ * instead of going through stdio.
+ */
+struct out_buf {
+    int     fd;
+    char    *buf;
+    size_t  size;
+    size_t  len;
+};
+
+int line_reader_open(struct line_reader *r, int fd);
+void line_reader_close(struct line_reader *r);
+int line_reader_next(struct line_reader *r, struct line_span *line);
+void line_reader_release(struct line_reader *r);
+
+int out_buf_init(struct out_buf *out, int fd, size_t size);
+void out_buf_free(struct out_buf *out);
+char *out_buf_reserve(struct out_buf *out, size_t n);
+int out_buf_flush(struct out_buf *out);
+
+#endif  /* LINEIO_H */
@@ -33,11 +33,23 @@
 #include <limits.h>
 #include <string.h>
 #include <ctype.h>
+#include <signal.h>
 
 #include "alloc.h"
 #include "info.h"
 #include "charset.h"
 #include "color.h"
+#include "filter.h"
+#include "entropy.h"
+#include "alias.h"
+#include "gen.h"
+#include "pattern.h"
+#include "hash.h"
+#include "shmpool.h"
+#include "ac.h"
+#include "encode.h"
+#include "lineio.h"
+#include "keyspace.h"
 
 #define DEFAULT_PLEN    6
 #define DEFAULT_PCNT    1
@@ -46,11 +58,25 @@
 #define PLEN_MAX        LONG_MAX
 #define PCNT_MIN        0
 #define PCNT_MAX        LONG_MAX
+#define THREADS_MIN     1
+#define THREADS_MAX     1024
 
 #define FAST_CHAR_OPT_MIN       1
 #define FAST_CHAR_OPT_MAX       4
 #define DEFAULT_FAST_CHAR_OPT   3
 
+#define FILTER_MAX_REJECT       1000    // consecutive denylist hits allowed
+
+#define HASH_BATCH              64      // records hashed per thread and batch
+#define ASSIGN_BATCH            1024    // identifiers read per batch unhashed
+#define INSECURE_BATCH          4096    // records per thread and batch with -X
+#define ENUM_BATCH              4096    // records per thread and batch with -E
+
+#define DEFAULT_KEY_BITS        128
+
+#define DEFAULT_POOL_SLOTS      256
+#define POOL_POLL_NS            1000000 // producer sleep while it can't fill
+
 /**
  * This macro checks range of N; N is a member of the set [MIN,MAX] 
  */
@@ -71,12 +97,31 @@ char *strdup(const char *str)
     return dup;
 }
 
-static char *generate(size_t len, char *table, int fd);
+static char *read_file(const char *path);
+static char *append_file(char *text, const char *path);
 static void die(char *msg, int status);
 static char *str_rmdup(const char *s);
+static int in_denylist(const struct filter *filter, const char *pass);
+static int make_record(const struct gen_prog *prog, struct entropy *src,
+                       const struct filter *filter, char *rec,
+                       size_t prefix_len);
+static int write_assigned(struct out_buf *out, const struct line_reader *in,
+                          const struct line_span *ids, const char *recs,
+                          size_t rec_size, const char *hashes, size_t n,
+                          const char *sep, int hash_only);
+static int run_pool_producer(struct shmpool *pool, const struct gen_prog *prog,
+                             struct entropy *src, const struct filter *filter,
+                             const char *prefix, size_t prefix_len);
+static size_t batch_size(size_t per_thread, long nthreads, long count);
+static int run_keyspace(const struct gen_prog *prog, const char *rank_pass,
+                        const char *start, long count, const char *prefix,
+                        long nthreads, int dump_on);
+static void pgen_stop(int sig);
+static long parse_long(const char *arg, const char *fname);
 static void pgen_exit_cleanup(void);
 
 static struct bst_node *g_alloc_bst     = NULL;      // bst for tracking heap allocation
+static volatile sig_atomic_t g_stop     = 0;         // set by termination signals
 
 int
 main(int argc, char **argv)
@@ -90,12 +135,51 @@ main(int argc, char **argv)
     int             prefix_on           = 0;
     int             dump_on             = 0;
     int             no_sub              = 0;
+    int             len_on              = 0;
+    int             cnt_on              = 0;
+    int             health_on           = 0;
+    int             threads_on          = 0;
 
     char *symtab                = NULL;
     char *pass_prefix           = NULL;
     char *exclude_list          = NULL;
     char *include_list          = NULL;
-    int fd;
+    char *filter_path           = NULL;
+    char *filter_list           = NULL;
+    struct filter filter        = { NULL, NULL, 0 };
+    char *weight_spec           = NULL;
+    char *weight_file           = NULL;
+    struct alias_table alias    = { 0, NULL, NULL, 0 };
+    char *pattern               = NULL;
+    struct gen_prog prog;
+    struct entropy src;
+    char *hash_scheme           = NULL;
+    long hash_rounds            = 0;
+    long nthreads               = sysconf(_SC_NPROCESSORS_ONLN);
+    int hash_only               = 0;
+    struct hash_opts hash_opts  = { HASH_NONE, 0 };
+    size_t prefix_len;
+    size_t rec_size;
+    size_t batch_len;
+    char *recs;
+    unsigned char *salts        = NULL;
+    char *hashes                = NULL;
+    char *pool_name             = NULL;
+    char *take_name             = NULL;
+    struct shmpool pool         = { NULL, NULL, 0, 0, 0 };
+    char *forbidden             = NULL;
+    struct ac_dfa dfa           = { NULL, NULL, 0, 0, 0, { 0 } };
+    encoding_t key_enc          = ENC_NONE;
+    long key_bits               = 0;
+    int assign_on               = 0;
+    char *assign_sep            = NULL;
+    struct line_reader in;
+    struct line_span *ids       = NULL;
+    struct out_buf out          = { -1, NULL, 0, 0 };
+    int insecure_on             = 0;
+    struct entropy *fast_srcs   = NULL;
+    char *enum_start            = NULL;
+    char *rank_pass             = NULL;
 
     int bad_args                = 0;
 
@@ -103,7 +187,7 @@ main(int argc, char **argv)
         die("E: cannot set exit function\n", EXIT_FAILURE);
 
     /* parse the command line arguments */
-    for (int opt; (opt = getopt(argc, argv, "CLUDPNdnhl:p:f:c:e:i:")) != -1; ) {
+    for (int opt; (opt = getopt(argc, argv, "CLUDPNdnhxaXvl:p:f:c:e:i:F:B:w:W:t:H:R:T:S:G:s:k:b:A:E:r:")) != -1; ) {
         char *endptr; 
 
         switch (opt) {
@@ -132,6 +216,9 @@ main(int argc, char **argv)
         case 'd':       // dump symbol table
             dump_on = 1;
             break;
+        case 'v':       // report entropy health test statistics
+            health_on = 1;
+            break;
         case 'l':       // length
             errno = 0;
             pass_len = strtol(optarg, &endptr, 0);
@@ -144,6 +231,7 @@ main(int argc, char **argv)
                 fprintf(stderr, "%s: invalid argument '%s'\n", *argv, optarg);
                 exit(EXIT_FAILURE);
             }
+            len_on = 1;
             break;
         case 'c':       // count
             errno = 0;
@@ -157,6 +245,7 @@ main(int argc, char **argv)
                 fprintf(stderr, "%s: invalid argument '%s'\n", *argv, optarg);
                 exit(EXIT_FAILURE); 
             }
+            cnt_on = 1;
             break;
         case 'f':       // fast character mode
             errno = 0;
@@ -202,6 +291,66 @@ main(int argc, char **argv)
                 die("pgen_alloc_bst_insert: allocation failed\n", EXIT_FAILURE);
             }
             break;
+        case 'F':       // denylist filter file
+            filter_path = optarg;
+            break;
+        case 'B':       // build denylist filter from list
+            filter_list = optarg;
+            break;
+        case 'w':       // symbol weights
+            weight_spec = optarg;
+            break;
+        case 'W':       // symbol weights file
+            weight_file = optarg;
+            break;
+        case 't':       // pattern
+            pattern = optarg;
+            break;
+        case 'H':       // hash scheme
+            hash_scheme = optarg;
+            break;
+        case 'R':       // hash rounds
+            hash_rounds = parse_long(optarg, *argv);
+            break;
+        case 'T':       // threads
+            nthreads = parse_long(optarg, *argv);
+            threads_on = 1;
+            break;
+        case 'x':       // hash only output
+            hash_only = 1;
+            break;
+        case 'S':       // shared memory pool producer
+            pool_name = optarg;
+            break;
+        case 'G':       // take password from shared memory pool
+            take_name = optarg;
+            break;
+        case 's':       // forbidden substrings file, may be repeated
+            if (!(forbidden = append_file(forbidden, optarg)))
+                exit(EXIT_FAILURE);
+            break;
+        case 'k':       // key encoding
+            if (!encoding_parse(optarg, &key_enc))
+                exit(EXIT_FAILURE);
+            break;
+        case 'b':       // key strength in bits
+            key_bits = parse_long(optarg, *argv);
+            break;
+        case 'a':       // assign passwords to identifiers read from stdin
+            assign_on = 1;
+            break;
+        case 'A':       // assign mode field separator
+            assign_sep = optarg;
+            break;
+        case 'X':       // insecure fast generator for test data
+            insecure_on = 1;
+            break;
+        case 'E':       // enumerate the keyspace from the given index
+            enum_start = optarg;
+            break;
+        case 'r':       // print the keyspace index of the given password
+            rank_pass = optarg;
+            break;
         case 'h':
             show_info(*argv);
             exit(EXIT_SUCCESS);
@@ -236,19 +385,139 @@ main(int argc, char **argv)
         fprintf(stderr, "%s: Bad password count (%li)\n", *argv, pass_cnt);
         bad_args = 1;
     }
-    if (prefix_on && !no_sub && (int) strlen(pass_prefix) >= pass_len) {
+    if (prefix_on && !no_sub && !pattern && !key_enc &&
+        (int) strlen(pass_prefix) >= pass_len)
+    {
         fprintf(stderr, "%s: Prefix must be shorter than password length\n"
                 "Use -n to turn off prefix substition\n",
                 *argv);
         bad_args = 1;
     }
 
+    if (key_enc && (pattern || weight_spec || weight_file)) {
+        fprintf(stderr, "%s: -k cannot be used with -t, -w or -W\n", *argv);
+        bad_args = 1;
+    }
+    if (key_bits && !key_enc) {
+        fprintf(stderr, "%s: -b requires a key encoding given by -k\n", *argv);
+        bad_args = 1;
+    }
+    if (key_bits && len_on) {
+        fprintf(stderr, "%s: -l cannot be used with -b, the strength sets the length\n",
+                *argv);
+        bad_args = 1;
+    }
+    if (key_bits < 0 || key_bits > PLEN_MAX / 4) {
+        fprintf(stderr, "%s: Bad key strength (%li)\n", *argv, key_bits);
+        bad_args = 1;
+    }
+    if (pattern && len_on) {
+        fprintf(stderr, "%s: -l cannot be used with -t, the pattern sets the length\n",
+                *argv);
+        bad_args = 1;
+    }
+    if ((hash_only || hash_rounds) && !hash_scheme) {
+        fprintf(stderr, "%s: -x and -R require a hash scheme given by -H\n",
+                *argv);
+        bad_args = 1;
+    }
+    // the online processor count is only a default, fit it into range
+    if (!threads_on)
+        nthreads = nthreads < THREADS_MIN ? THREADS_MIN
+                 : nthreads > THREADS_MAX ? THREADS_MAX : nthreads;
+    if (!IN_RANGE(THREADS_MIN, THREADS_MAX, nthreads)) {
+        fprintf(stderr, "%s: Bad thread count (%li)\n", *argv, nthreads);
+        bad_args = 1;
+    }
+    if (pool_name && take_name) {
+        fprintf(stderr, "%s: -S and -G cannot be used together\n", *argv);
+        bad_args = 1;
+    }
+    if ((pool_name || take_name) && hash_scheme) {
+        fprintf(stderr, "%s: -H cannot be used with a password pool\n", *argv);
+        bad_args = 1;
+    }
+    if (assign_sep && !assign_on) {
+        fprintf(stderr, "%s: -A requires -a\n", *argv);
+        bad_args = 1;
+    }
+    if (assign_on && (cnt_on || color_on)) {
+        fprintf(stderr, "%s: -a cannot be used with -c or -C, one password is "
+                "made per input line\n", *argv);
+        bad_args = 1;
+    }
+    if (assign_on && (pool_name || take_name)) {
+        fprintf(stderr, "%s: -a cannot be used with a password pool\n", *argv);
+        bad_args = 1;
+    }
+    if (insecure_on && (hash_scheme || filter_path || filter_list || key_enc ||
+                        assign_on || pool_name || take_name))
+    {
+        fprintf(stderr, "%s: -X output is predictable and cannot be used with "
+                "-H, -F, -B, -k, -a, -S or -G\n", *argv);
+        bad_args = 1;
+    }
+    if (insecure_on && color_on) {
+        fprintf(stderr, "%s: -X cannot be used with -C\n", *argv);
+        bad_args = 1;
+    }
+    if (enum_start && rank_pass) {
+        fprintf(stderr, "%s: -E and -r cannot be used together\n", *argv);
+        bad_args = 1;
+    }
+    if ((enum_start || rank_pass) &&
+        (key_enc || weight_spec || weight_file || forbidden || filter_path ||
+         hash_scheme || assign_on || insecure_on || pool_name || take_name ||
+         color_on))
+    {
+        fprintf(stderr, "%s: -E and -r cannot be used with -k, -w, -W, -s, -F, "
+                "-H, -a, -X, -S, -G or -C\n", *argv);
+        bad_args = 1;
+    }
+    if (filter_list && !filter_path) {
+        fprintf(stderr, "%s: -B requires an output filter file given by -F\n",
+                *argv);
+        bad_args = 1;
+    }
+
     // if arguments are bad, cleanup and exit
     if (bad_args) {
         fprintf(stderr, "%s -h for usage\n", *argv);
         exit(EXIT_FAILURE);
     }
 
+    // filter build mode, compile list and exit
+    if (filter_list) {
+        if (!filter_build(filter_list, filter_path))
+            exit(EXIT_FAILURE);
+        exit(EXIT_SUCCESS);
+    }
+
+    // pool consumer mode, take one password and exit
+    if (take_name) {
+        char *pass;
+
+        if (!shmpool_open(&pool, take_name))
+            exit(EXIT_FAILURE);
+        if (!(pass = malloc(pool.hdr->slot_size)))
+            die("malloc: allocation failed\n", EXIT_FAILURE);
+        if (!shmpool_take(&pool, pass)) {
+            fprintf(stderr, "%s: pool '%s' is empty\n", *argv, take_name);
+            exit(EXIT_FAILURE);
+        }
+        printf((color_on) ? ANSI_COLORTERM_YELLOW("%s\n") : "%s\n", pass);
+        fflush(stdout);
+        memset(pass, 0, pool.hdr->slot_size);
+        free(pass);
+        shmpool_close(&pool);
+        exit(EXIT_SUCCESS);
+    }
+
+    if (filter_path && !filter_open(&filter, filter_path))
+        exit(EXIT_FAILURE);
+    if (hash_scheme && !hash_opts_init(&hash_opts, hash_scheme, hash_rounds))
+        exit(EXIT_FAILURE);
+
     // set char_opt if using fast option
     if (fast_char_opt_on) {
         switch (fast_char_opt) {
@@ -272,7 +541,7 @@ main(int argc, char **argv)
     }
 
     // if using prefix, shorten length to make room for prefix
-    if (prefix_on && !no_sub)
+    if (prefix_on && !no_sub && !pattern && !key_enc)
         pass_len -= strlen(pass_prefix);
 
     // generate character set for password symbol table
@@ -280,7 +549,6 @@ main(int argc, char **argv)
     if (!symtab) {
         die("generate_charset: allocation failed\n", EXIT_FAILURE);
     }
-    if (exclude_list) pgen_free(&g_alloc_bst, exclude_list);
     if (include_list) pgen_free(&g_alloc_bst, include_list);
     if (!pgen_alloc_bst_insert(&g_alloc_bst, symtab)) {
         die("pgen_alloc_bst_insert: allocation failed\n", EXIT_FAILURE);
@@ -288,37 +556,311 @@ main(int argc, char **argv)
 
     // dump symbol table
     if (dump_on)
-        printf("symbols: %s\n", symtab);
+        printf("symbols: %s\n", key_enc ? encoding_alphabet(key_enc) : symtab);
     
-    // check for zero length symbol table
-    if (strlen(symtab) == 0) {
+    // check for zero length symbol table, patterns and keys need not use it
+    if (strlen(symtab) == 0 && !pattern && !key_enc) {
         fprintf(stderr, "%s: invalid table length '0'\n", *argv);
         exit(EXIT_FAILURE);
     }
 
+    // compile symbol weights into an alias table
+    if (weight_spec || weight_file) {
+        size_t  symtab_len = strlen(symtab);
+        double  *weights;
+        char    *file_spec = NULL;
+
+        if (!(weights = malloc(symtab_len * sizeof(double))))
+            die("malloc: allocation failed\n", EXIT_FAILURE);
+        for (size_t i = 0; i < symtab_len; ++i)
+            weights[i] = 1.0;
+
+        if (weight_file && !(file_spec = read_file(weight_file)))
+            exit(EXIT_FAILURE);
+        if ((file_spec && !weights_parse(file_spec, symtab, weights)) ||
+            (weight_spec && !weights_parse(weight_spec, symtab, weights)) ||
+            !alias_build(&alias, weights, symtab_len))
+        {
+            exit(EXIT_FAILURE);
+        }
+        free(file_spec);
+        free(weights);
+
+        if (!pgen_alloc_bst_insert(&g_alloc_bst, alias.prob)) {
+            die("pgen_alloc_bst_insert: allocation failed\n", EXIT_FAILURE);
+        }
+    }
+
+    /*
+     * compile the generator program, a key encoding, a pattern or a single
+     * run over symtab
+     */
+    if (key_enc) {
+        size_t key_len = len_on ? (size_t) pass_len
+                       : encoding_len(key_enc, key_bits ? key_bits
+                                                        : DEFAULT_KEY_BITS);
+
+        if (!gen_prog_key(&prog, key_enc, key_len))
+            exit(EXIT_FAILURE);
+    } else if (pattern) {
+        if (!pattern_compile(&prog, pattern, exclude_list, symtab,
+                             alias.prob ? &alias : NULL))
+        {
+            exit(EXIT_FAILURE);
+        }
+    } else if (!gen_prog_uniform(&prog, symtab, alias.prob ? &alias : NULL,
+                                 pass_len))
+    {
+        exit(EXIT_FAILURE);
+    }
+    if (exclude_list) pgen_free(&g_alloc_bst, exclude_list);
+
+    /*
+     * compile forbidden substrings over the symbols prog can generate and
+     * those of the prefix, which is scanned along with each password
+     */
+    if (forbidden) {
+        unsigned char alphabet[256];
+
+        gen_prog_alphabet(&prog, alphabet);
+        for (const char *p = prefix_on ? pass_prefix : ""; *p; ++p)
+            alphabet[(unsigned char) *p] = 1;
+        if (!ac_compile(&dfa, forbidden, alphabet))
+            exit(EXIT_FAILURE);
+        free(forbidden);
+        if (dfa.npatterns &&
+            !gen_prog_forbid(&prog, &dfa, prefix_on ? pass_prefix : NULL))
+        {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // report entropy so lengths can be sized to a policy
+    if (dump_on) {
+        double bits = gen_prog_entropy(&prog);
+
+        printf("entropy: %.3f bits/symbol, %.1f bits/password\n",
+               prog.len ? bits / prog.len : 0.0, bits);
+    }
+
+    // keyspace modes number the strings prog can produce instead of drawing
+    if (enum_start || rank_pass) {
+        int ok = run_keyspace(&prog, rank_pass, enum_start,
+                              cnt_on ? pass_cnt : -1,
+                              prefix_on ? pass_prefix : NULL, nthreads, dump_on);
+
+        gen_prog_free(&prog);
+        exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
     // open /dev/urandom for use as pseudorandom source
-    if ((fd = open("/dev/urandom", O_RDONLY)) == -1) {
-        perror("open");
+    if (!entropy_open(&src, ENTROPY_PATH))
         exit(EXIT_FAILURE);
+
+    /*
+     * insecure mode seeds one xoshiro256** stream from the device and jumps
+     * ahead from it for each further thread, so streams never overlap
+     */
+    if (insecure_on) {
+        uint64_t seed[4];
+
+        if (!(fast_srcs = malloc(nthreads * sizeof(struct entropy))))
+            die("malloc: allocation failed\n", EXIT_FAILURE);
+        if (!entropy_read(&src, seed, sizeof seed) ||
+            !entropy_open_insecure(&fast_srcs[0], seed))
+        {
+            exit(EXIT_FAILURE);
+        }
+        for (long t = 1; t < nthreads; ++t) {
+            fast_srcs[t] = fast_srcs[t - 1];
+            entropy_jump(&fast_srcs[t]);
+        }
     }
 
-    for (long i = 0; i < pass_cnt; ++i) {
-        char *pass;
+    /*
+     * Passwords are produced in batches of records holding prefix and
+     * password. Without hashing a batch is a single record, otherwise a
+     * batch is generated here and hashed across all threads.
+     */
+    prefix_len = prefix_on ? strlen(pass_prefix) : 0;
+    rec_size   = prefix_len + prog.len + 1;
 
-        /* We needn't add pass to tree since we free ASAP */
-        if (!(pass = generate(pass_len, symtab, fd))) {
-            fprintf(stderr, "%s: failed to generate string\n", *argv);
+    // pool producer mode, keep the pool filled until terminated
+    if (pool_name) {
+        struct sigaction sa;
+        int ok;
+
+        memset(&sa, 0, sizeof sa);
+        sa.sa_handler = pgen_stop;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGINT, &sa, NULL) == -1 ||
+            sigaction(SIGTERM, &sa, NULL) == -1 ||
+            sigaction(SIGHUP, &sa, NULL) == -1)
+        {
+            perror("sigaction");
             exit(EXIT_FAILURE);
         }
-        
-        printf((color_on) ? ANSI_COLORTERM_YELLOW("%s%s\n") : "%s%s\n",
-               (prefix_on) ? pass_prefix : "", pass);
 
-        free(pass);
+        if (!shmpool_create(&pool, pool_name,
+                            cnt_on ? (size_t) pass_cnt : DEFAULT_POOL_SLOTS,
+                            rec_size))
+        {
+            exit(EXIT_FAILURE);
+        }
+        ok = run_pool_producer(&pool, &prog, &src, filter.hdr ? &filter : NULL,
+                               prefix_on ? pass_prefix : NULL, prefix_len);
+        if (health_on)
+            entropy_report(&src);
+        shmpool_unlink(&pool, pool_name);
+        shmpool_close(&pool);
+        exit(ok ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+    batch_len  = hash_opts.scheme != HASH_NONE
+                 ? batch_size(HASH_BATCH, nthreads, assign_on ? -1 : pass_cnt)
+                 : 1;
+    if (insecure_on) {
+        batch_len = batch_size(INSECURE_BATCH, nthreads, pass_cnt);
+
+        fflush(stdout);
+        if (!out_buf_init(&out, STDOUT_FILENO, LINEIO_BUF_SIZE))
+            exit(EXIT_FAILURE);
+    }
+    if (assign_on) {
+        /*
+         * assign mode reads a batch of identifiers and pairs them with a
+         * batch of records in input order, the count is set by the input
+         */
+        if (hash_opts.scheme == HASH_NONE)
+            batch_len = ASSIGN_BATCH;
+        pass_cnt = LONG_MAX;
+
+        fflush(stdout);
+        if (!line_reader_open(&in, STDIN_FILENO) ||
+            !out_buf_init(&out, STDOUT_FILENO, LINEIO_BUF_SIZE))
+        {
+            exit(EXIT_FAILURE);
+        }
+        if (!(ids = malloc(batch_len * sizeof(struct line_span))))
+            die("malloc: allocation failed\n", EXIT_FAILURE);
+        if (!assign_sep)
+            assign_sep = "\t";
+    } else if (pass_cnt < (long) batch_len) {
+        batch_len = pass_cnt ? pass_cnt : 1;
+    }
+
+    if (!(recs = malloc(batch_len * rec_size)))
+        die("malloc: allocation failed\n", EXIT_FAILURE);
+    for (size_t k = 0; prefix_on && k < batch_len; ++k)
+        memcpy(recs + k * rec_size, pass_prefix, prefix_len);
+    if (hash_opts.scheme != HASH_NONE) {
+        salts  = malloc(batch_len * HASH_SALT_LEN);
+        hashes = malloc(batch_len * HASH_MAX_LEN);
+        if (!salts || !hashes)
+            die("malloc: allocation failed\n", EXIT_FAILURE);
+    }
+
+    for (long i = 0; i < pass_cnt; ) {
+        size_t n = (size_t) (pass_cnt - i) < batch_len ? (size_t) (pass_cnt - i)
+                                                       : batch_len;
+
+        if (assign_on) {
+            for (n = 0; n < batch_len && line_reader_next(&in, &ids[n]); ++n)
+                ;
+            if (in.err)
+                exit(EXIT_FAILURE);
+            if (!n)
+                break;
+        }
+
+        /*
+         * insecure mode generates across all threads straight into the
+         * output buffer, the string terminators become line ends
+         */
+        if (insecure_on) {
+            char *p;
+
+            if (!(p = out_buf_reserve(&out, n * rec_size)))
+                exit(EXIT_FAILURE);
+            for (size_t k = 0; prefix_on && k < n; ++k)
+                memcpy(p + k * rec_size, pass_prefix, prefix_len);
+            if (!gen_batch(&prog, fast_srcs, p, rec_size, prefix_len, n,
+                           nthreads))
+            {
+                fprintf(stderr, "%s: failed to generate string\n", *argv);
+                exit(EXIT_FAILURE);
+            }
+            for (size_t k = 1; k <= n; ++k)
+                p[k * rec_size - 1] = '\n';
+            out.len += n * rec_size;
+            i += n;
+            continue;
+        }
+
+        for (size_t k = 0; k < n; ++k) {
+            if (!make_record(&prog, &src, filter.hdr ? &filter : NULL,
+                             recs + k * rec_size, prefix_len))
+            {
+                fprintf(stderr, "%s: failed to generate string\n", *argv);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        if (hash_opts.scheme != HASH_NONE) {
+            if (!entropy_read(&src, salts, n * HASH_SALT_LEN) ||
+                !hash_batch(&hash_opts, recs, rec_size, salts, hashes, n, nthreads))
+            {
+                fprintf(stderr, "%s: failed to hash passwords\n", *argv);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        if (assign_on) {
+            if (!write_assigned(&out, &in, ids, recs, rec_size, hashes, n,
+                                assign_sep, hash_only))
+            {
+                exit(EXIT_FAILURE);
+            }
+            line_reader_release(&in);
+            i += n;
+            continue;
+        }
+
+        for (size_t k = 0; k < n; ++k) {
+            char *rec  = recs + k * rec_size;
+            char *hash = hashes ? hashes + k * HASH_MAX_LEN : NULL;
+
+            if (hash_opts.scheme == HASH_NONE)
+                printf((color_on) ? ANSI_COLORTERM_YELLOW("%s\n") : "%s\n", rec);
+            else if (hash_only)
+                printf((color_on) ? ANSI_COLORTERM_YELLOW("%s\n") : "%s\n", hash);
+            else
+                printf((color_on) ? ANSI_COLORTERM_YELLOW("%s\t%s\n") : "%s\t%s\n",
+                       rec, hash);
+        }
+        i += n;
+    }
+    if (assign_on || insecure_on) {
+        if (!out_buf_flush(&out))
+            exit(EXIT_FAILURE);
+        out_buf_free(&out);
+    }
+    if (assign_on) {
+        line_reader_close(&in);
+        free(ids);
     }
+    free(fast_srcs);
+    if (health_on)
+        entropy_report(&src);
     fflush(stdout);
+    memset(recs, 0, batch_len * rec_size);
+    free(recs);
+    free(salts);
+    free(hashes);
+    gen_prog_free(&prog);
+    ac_free(&dfa);
     pgen_free(&g_alloc_bst, pass_prefix);
-    close(fd);
+    filter_close(&filter);
+    entropy_close(&src);
 
     // cleanup after return
     return EXIT_SUCCESS;
@@ -363,71 +905,358 @@ str_rmdup(const char *s)
 }
 
 /**
- * Print an error message to stderr and exit
+ * Returns nonzero if pass is found in the denylist filter
  */
-static void
-die(char *msg, int status)
+static int
+in_denylist(const struct filter *filter, const char *pass)
 {
-    if (msg)
-        fputs(msg, stderr);
+    return filter_contains(filter, filter_hash(FILTER_HASH_BASIS, pass,
+                                               strlen(pass)));
+}
 
-    exit(status);
+/**
+ * Generates a password into rec after its prefix_len byte prefix, which
+ * must already be in place. Candidates found in the denylist filter, if
+ * given, are generated again. Returns 1 on success, on failure an error is
+ * printed to stderr and 0 is returned.
+ */
+static int
+make_record(const struct gen_prog *prog, struct entropy *src,
+            const struct filter *filter, char *rec, size_t prefix_len)
+{
+    for (int rejected = 0; rejected < FILTER_MAX_REJECT; ++rejected) {
+        if (!gen_run(prog, src, rec + prefix_len))
+            return 0;
+        if (!filter || !in_denylist(filter, rec))
+            return 1;
+    }
+    fprintf(stderr, "E: denylist rejected %d candidates in a row\n",
+            FILTER_MAX_REJECT);
+
+    return 0;
 }
 
 /**
- * Generates a pseudorandom string, composed of symbols selected from table.
- * table must be a pointer to a NULL terminated character array, this is
- * necessary for the function to be able to determine length without taking
- * the length as a parameter.
- * Returns a pointer to the generated string on success, on failure a NULL
- * pointer will be returned.
+ * Writes n records of the form id<sep>password, or id<sep>password<sep>hash
+ * when hashes are given, to out. With hash_only the password is left out.
+ * Identifiers are copied from the input unchanged. Returns 1 on success, on
+ * failure an error is printed to stderr and 0 is returned.
  */
-static char *
-generate(size_t len, char *table, int fd)
+static int
+write_assigned(struct out_buf *out, const struct line_reader *in,
+               const struct line_span *ids, const char *recs, size_t rec_size,
+               const char *hashes, size_t n, const char *sep, int hash_only)
+{
+    size_t sep_len = strlen(sep);
+
+    for (size_t k = 0; k < n; ++k) {
+        const char  *rec      = recs + k * rec_size;
+        const char  *hash     = hashes ? hashes + k * HASH_MAX_LEN : NULL;
+        size_t      rec_len   = hash_only ? 0 : rec_size - 1;
+        size_t      hash_len  = hash ? strlen(hash) : 0;
+        size_t      len;
+        char        *p;
+
+        len = ids[k].len + sep_len + rec_len + hash_len + 1;
+        if (hash && !hash_only)
+            len += sep_len;
+        if (!(p = out_buf_reserve(out, len)))
+            return 0;
+
+        memcpy(p, in->buf + ids[k].off, ids[k].len);
+        p += ids[k].len;
+        memcpy(p, sep, sep_len);
+        p += sep_len;
+        memcpy(p, rec, rec_len);
+        p += rec_len;
+        if (hash) {
+            if (!hash_only) {
+                memcpy(p, sep, sep_len);
+                p += sep_len;
+            }
+            memcpy(p, hash, hash_len);
+            p += hash_len;
+        }
+        *p = '\n';
+        out->len += len;
+    }
+
+    return 1;
+}
+
+/**
+ * Returns the records per batch for per_thread records on each of nthreads
+ * threads, but no more than count if count is not negative. Comparing
+ * before multiplying keeps a short run from allocating a batch per thread.
+ */
+static size_t
+batch_size(size_t per_thread, long nthreads, long count)
+{
+    if (count >= 0 && (size_t) count / per_thread < (size_t) nthreads)
+        return count ? (size_t) count : 1;
+
+    return per_thread * nthreads;
+}
+
+/**
+ * Runs the keyspace modes over the strings prog produces. With rank_pass,
+ * prints its index. Otherwise prints count strings, or all that are left if
+ * count is negative, from the decimal index start on, generated across
+ * nthreads threads. Strings follow prefix if given. Returns 1 on success,
+ * on failure an error is printed to stderr and 0 is returned.
+ */
+static int
+run_keyspace(const struct gen_prog *prog, const char *rank_pass,
+             const char *start, long count, const char *prefix,
+             long nthreads, int dump_on)
 {
-    char            *pstring = NULL;
-    size_t          table_len = strlen(table);
+    struct keyspace ks;
+    struct out_buf  out        = { -1, NULL, 0, 0 };
+    uint32_t        *idx       = NULL;
+    size_t          prefix_len = prefix ? strlen(prefix) : 0;
+    size_t          rec_size   = prefix_len + prog->len + 1;
+    size_t          batch_len;
+    uint64_t        left;
+    char            *s;
+    int             ret        = 0;
 
-    // check for invalid parameters
-    if (table_len < 1) {
-        fprintf(stderr, "E: invalid table length '%zd'\n", table_len);
-        goto fail;
+    if (!keyspace_init(&ks, prog))
+        return 0;
+    if (!(idx = keyspace_index(&ks)))
+        goto done;
+
+    if (dump_on) {
+        if (!(s = keyspace_format(&ks, ks.size)))
+            goto done;
+        printf("keyspace: %s strings\n", s);
+        free(s);
+    }
+
+    if (rank_pass) {
+        if (prefix) {
+            if (strncmp(rank_pass, prefix, prefix_len)) {
+                fprintf(stderr, "E: '%s' does not start with the prefix\n",
+                        rank_pass);
+                goto done;
+            }
+            rank_pass += prefix_len;
+        }
+        if (!keyspace_rank(&ks, rank_pass, idx) ||
+            !(s = keyspace_format(&ks, idx)))
+        {
+            goto done;
+        }
+        printf("%s\n", s);
+        free(s);
+        ret = 1;
+        goto done;
     }
 
-    if (!(pstring = malloc((len + 1) * sizeof(char)))) {
-        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
-        goto fail;
+    if (!keyspace_parse(&ks, start, idx))
+        goto done;
+    left = keyspace_left(&ks, idx);
+    if (count < 0) {
+        count = left > LONG_MAX ? LONG_MAX : (long) left;
+    } else if ((uint64_t) count > left) {
+        fprintf(stderr, "E: range exceeds the keyspace, %lu strings are left\n",
+                (unsigned long) left);
+        goto done;
     }
+    batch_len = batch_size(ENUM_BATCH, nthreads, count);
 
-    // produce a pseudorandom string comprised of characters from table
-    for (size_t i = 0; i < len; ++i) {
-        unsigned int rand;
-        unsigned int max_rand = UINT_MAX - ((long int) UINT_MAX + 1) % table_len;
+    fflush(stdout);
+    if (!out_buf_init(&out, STDOUT_FILENO, LINEIO_BUF_SIZE))
+        goto done;
+    while (count > 0) {
+        size_t  n = (size_t) count < batch_len ? (size_t) count : batch_len;
+        char    *p;
 
-        if (read(fd, &rand, sizeof rand) == -1) {
-            perror("read");
-            goto fail;
+        if (!(p = out_buf_reserve(&out, n * rec_size)))
+            goto done;
+        for (size_t k = 0; prefix && k < n; ++k)
+            memcpy(p + k * rec_size, prefix, prefix_len);
+        if (!keyspace_enumerate(&ks, idx, p, rec_size, prefix_len, n, nthreads))
+            goto done;
+        for (size_t k = 1; k <= n; ++k)
+            p[k * rec_size - 1] = '\n';
+        out.len += n * rec_size;
+
+        keyspace_advance(&ks, idx, n);
+        count -= n;
+    }
+    ret = out_buf_flush(&out);
+
+done:
+    out_buf_free(&out);
+    free(idx);
+    keyspace_free(&ks);
+    return ret;
+}
+
+/**
+ * Keeps pool filled until a termination signal arrives. Once the number of
+ * unclaimed passwords drops to the low water mark of a quarter of the pool,
+ * the pool is filled up completely again. Returns 1 on termination by
+ * signal, on failure an error is printed to stderr and 0 is returned.
+ */
+static int
+run_pool_producer(struct shmpool *pool, const struct gen_prog *prog,
+                  struct entropy *src, const struct filter *filter,
+                  const char *prefix, size_t prefix_len)
+{
+    size_t          low_water = pool->hdr->slots / 4;
+    struct timespec pause     = { 0, POOL_POLL_NS };
+
+    while (!g_stop) {
+        char *slot;
+
+        if (shmpool_fill(pool) > low_water) {
+            nanosleep(&pause, NULL);
+            continue;
+        }
+
+        while (!g_stop && (slot = shmpool_slot(pool))) {
+            if (prefix_len)
+                memcpy(slot, prefix, prefix_len);
+            if (!make_record(prog, src, filter, slot, prefix_len))
+                return 0;
+            shmpool_publish(pool);
         }
-        
-        // ensure against modulo bias
-        while (rand > max_rand) {
-            if (read(fd, &rand, sizeof rand) == -1) {
-                perror("read");
+
+        // the head slot is still claimed by a consumer, which may have died
+        // before handing it back, so wait instead of spinning
+        if (!g_stop)
+            nanosleep(&pause, NULL);
+    }
+
+    return 1;
+}
+
+/**
+ * Signal handler requesting a clean stop
+ */
+static void
+pgen_stop(int sig)
+{
+    (void) sig;
+    g_stop = 1;
+}
+
+/**
+ * Parses a numeric option argument, exits with an error message if arg is
+ * not a valid number
+ */
+static long
+parse_long(const char *arg, const char *fname)
+{
+    char *endptr;
+    long n;
+
+    errno = 0;
+    n = strtol(arg, &endptr, 0);
+    if ((errno == ERANGE && (n == LONG_MAX || n == LONG_MIN))
+               || (errno != 0 && n == 0))
+    {
+        perror("strtol");
+        exit(EXIT_FAILURE);
+    } else if (endptr == arg || *endptr != '\0') {
+        fprintf(stderr, "%s: invalid argument '%s'\n", fname, arg);
+        exit(EXIT_FAILURE);
+    }
+
+    return n;
+}
+
+/**
+ * Reads the whole file at path into a null terminated buffer which must be
+ * freed by the caller. On failure an error is printed to stderr and NULL is
+ * returned.
+ */
+static char *
+read_file(const char *path)
+{
+    char    *buf  = NULL;
+    size_t  len   = 0;
+    size_t  size  = 0;
+    ssize_t n;
+    int     fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1) {
+        perror(path);
+        return NULL;
+    }
+
+    do {
+        if (size - len < 2) {
+            char *tmp;
+
+            size = size ? size * 2 : BUFSIZ;
+            if (!(tmp = realloc(buf, size))) {
+                fprintf(stderr, "E: failed to allocate memory (realloc)\n");
                 goto fail;
             }
+            buf = tmp;
         }
+        if ((n = read(fd, buf + len, size - len - 1)) == -1) {
+            perror("read");
+            goto fail;
+        }
+        len += n;
+    } while (n);
 
-        pstring[i] = table[rand % table_len];
-    }
-    pstring[len] = '\0';
+    close(fd);
+    buf[len] = '\0';
 
-    return pstring;
+    return buf;
 
 fail:
-    if (pstring) free(pstring);
+    close(fd);
+    free(buf);
     return NULL;
 }
 
+/**
+ * Appends the contents of the file at path to text, which may be NULL, on a
+ * new line. Returns the new text, which must be freed by the caller, on
+ * failure an error is printed to stderr and NULL is returned.
+ */
+static char *
+append_file(char *text, const char *path)
+{
+    char    *file;
+    char    *ret;
+    size_t  len;
+
+    if (!(file = read_file(path)))
+        return NULL;
+    if (!text)
+        return file;
+
+    len = strlen(text);
+    if (!(ret = realloc(text, len + strlen(file) + 2))) {
+        fprintf(stderr, "E: failed to allocate memory (realloc)\n");
+        free(file);
+        return NULL;
+    }
+    ret[len] = '\n';
+    strcpy(ret + len + 1, file);
+    free(file);
+
+    return ret;
+}
+
+/**
+ * Print an error message to stderr and exit
+ */
+static void
+die(char *msg, int status)
+{
+    if (msg)
+        fputs(msg, stderr);
+
+    exit(status);
+}
+
 static void
 pgen_exit_cleanup(void)
 {
@@ -0,0 +1,202 @@
+/*****************************************************************************
+ * Pattern compiler for pgen
+ *
+ * A pattern describes a password position by position:
+ *
+ *   l  lowercase letter      L  uppercase letter      d  digit
+ *   p  punctuation           a  any letter            n  letter or digit
+ *   *  any symbol of the symbol table selected by the other options
+ *   [...]  any of the enclosed characters
+ *   \c     the character c
+ *   {n}    repeat the preceding item n times
+ *
+ * Any other character stands for itself. Consecutive positions drawing from
+ * the same table are merged into a single op, e.g. "Llll-dddd" compiles to
+ * four ops: (L, 1) (l, 3) (-, 1) (d, 4).
+ ****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "pattern.h"
+#include "charset.h"
+
+static const struct {
+    char            code;
+    charset_opt_t   opt;
+} pattern_classes[] = {
+    { 'l', LOWER },
+    { 'L', UPPER },
+    { 'd', DIGIT },
+    { 'p', PUNCT },
+    { 'a', LOWER | UPPER },
+    { 'n', LOWER | UPPER | DIGIT },
+};
+
+#define NCLASSES    (sizeof pattern_classes / sizeof *pattern_classes)
+#define MAX_TABLE   ('~' - '!' + 2)     // printable symbols plus terminator
+
+/*
+ * Parses a [...] set starting after the opening bracket into table, which
+ * is sorted and freed of duplicates. Returns a pointer past the closing
+ * bracket, or NULL if the set is unterminated.
+ */
+static const char *
+parse_set(const char *p, char *table)
+{
+    size_t n = 0;
+
+    while (*p && *p != ']') {
+        if (*p == '\\' && p[1])
+            ++p;
+        table[n++] = *p++;
+    }
+    if (!*p)
+        return NULL;
+
+    qsort(table, n, sizeof(char), cmpchar);
+    {
+        size_t j = 0;
+
+        for (size_t i = 0; i < n; ++i)
+            if (!j || table[i] != table[j - 1])
+                table[j++] = table[i];
+        table[j] = '\0';
+    }
+
+    return p + 1;
+}
+
+/**
+ * Compiles pattern into prog. Class tables honour the exclude list, '*'
+ * draws from symtab according to alias, which may be NULL. Returns 1 on
+ * success, on failure an error is printed to stderr and 0 is returned.
+ */
+int
+pattern_compile(struct gen_prog *prog, const char *pattern,
+                const char *exclude, const char *symtab,
+                const struct alias_table *alias)
+{
+    const char  *class_table[NCLASSES] = { NULL };
+    const char  *symtab_copy = NULL;
+    size_t      pattern_len  = strlen(pattern);
+    size_t      strtab_used  = 0;
+    const char  *p           = pattern;
+
+    memset(prog, 0, sizeof(struct gen_prog));
+
+    /*
+     * Every item stores at most one table, and each table is no longer than
+     * the text of its item plus terminator, except for the class tables and
+     * the symbol table, which are stored only once each.
+     */
+    prog->ops    = malloc((pattern_len + 1) * sizeof(struct gen_op));
+    prog->strtab = malloc(2 * pattern_len + (NCLASSES + 1) * MAX_TABLE +
+                          strlen(symtab) + 1);
+    if (!prog->ops || !prog->strtab) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        goto fail;
+    }
+
+    while (*p) {
+        const char                  *item  = p;
+        const struct alias_table    *a     = NULL;
+        char                        *table = prog->strtab + strtab_used;
+        size_t                      table_len;
+        unsigned long               run    = 1;
+        size_t                      i;
+
+        for (i = 0; i < NCLASSES && pattern_classes[i].code != *p; ++i)
+            ;
+
+        if (i < NCLASSES) {
+            if (!class_table[i]) {
+                char *set = generate_charset(pattern_classes[i].opt, exclude, NULL);
+
+                if (!set) {
+                    fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+                    goto fail;
+                }
+                strcpy(table, set);
+                free(set);
+                class_table[i] = table;
+                strtab_used += strlen(table) + 1;
+            }
+            table = (char *) class_table[i];
+            ++p;
+        } else if (*p == '*') {
+            if (!symtab_copy) {
+                strcpy(table, symtab);
+                symtab_copy = table;
+                strtab_used += strlen(table) + 1;
+            }
+            table = (char *) symtab_copy;
+            a = alias;
+            ++p;
+        } else if (*p == '[') {
+            if (!(p = parse_set(p + 1, table))) {
+                fprintf(stderr, "E: pattern: unterminated set near '%.16s'\n", item);
+                goto fail;
+            }
+            strtab_used += strlen(table) + 1;
+        } else if (*p == '{') {
+            fprintf(stderr, "E: pattern: repeat without item near '%.16s'\n", item);
+            goto fail;
+        } else {
+            if (*p == '\\' && p[1])
+                ++p;
+            table[0] = *p++;
+            table[1] = '\0';
+            strtab_used += 2;
+        }
+
+        table_len = strlen(table);
+        if (table_len == 0) {
+            fprintf(stderr, "E: pattern: no symbols to draw from near '%.16s'\n",
+                    item);
+            goto fail;
+        }
+
+        if (*p == '{') {
+            char *end;
+
+            run = strtoul(p + 1, &end, 10);
+            if (end == p + 1 || *end != '}' || run > LONG_MAX) {
+                fprintf(stderr, "E: pattern: bad repeat count near '%.16s'\n", item);
+                goto fail;
+            }
+            p = end + 1;
+        }
+        if (prog->len + run > LONG_MAX) {
+            fprintf(stderr, "E: pattern: too long\n");
+            goto fail;
+        }
+        prog->len += run;
+
+        // extend previous op if it draws from the same table
+        if (prog->nops) {
+            struct gen_op *prev = &prog->ops[prog->nops - 1];
+
+            if (prev->alias == a && prev->table_len == table_len &&
+                !memcmp(prev->table, table, table_len))
+            {
+                prev->run += run;
+                continue;
+            }
+        }
+
+        prog->ops[prog->nops].table     = table;
+        prog->ops[prog->nops].table_len = table_len;
+        prog->ops[prog->nops].alias     = a;
+        prog->ops[prog->nops].run       = run;
+        ++prog->nops;
+    }
+
+    return 1;
+
+fail:
+    gen_prog_free(prog);
+    return 0;
+}
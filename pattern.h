@@ -0,0 +1,11 @@
+#ifndef PATTERN_H
+#define PATTERN_H
+
+#include "alias.h"
+#include "gen.h"
+
+int pattern_compile(struct gen_prog *prog, const char *pattern,
+                    const char *exclude, const char *symtab,
+                    const struct alias_table *alias);
+
+#endif  /* PATTERN_H */
@@ -0,0 +1,22 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_BLOCK_LEN    64
+#define SHA256_DIGEST_LEN   32
+
+struct sha256_ctx {
+    uint32_t        state[8];
+    uint64_t        len;        // total bytes hashed
+    size_t          fill;       // bytes in block
+    unsigned char   block[SHA256_BLOCK_LEN];
+};
+
+void sha256_init(struct sha256_ctx *ctx);
+void sha256_update(struct sha256_ctx *ctx, const void *data, size_t n);
+void sha256_final(struct sha256_ctx *ctx, unsigned char *digest);
+void sha256(const void *data, size_t n, unsigned char *digest);
+
+#endif  /* SHA256_H */
@@ -0,0 +1,314 @@
+/*****************************************************************************
+ * Shared memory password pool for pgen
+ *
+ * One producer keeps a ring of pre-generated passwords in POSIX shared
+ * memory, any number of consumer processes take one each. Taking a password
+ * needs no system call once the pool is mapped: a consumer claims a position
+ * by advancing the tail index with compare and swap, copies the password,
+ * wipes the slot and hands the slot back to the producer by bumping its
+ * sequence number.
+ *
+ * The segment is created with mode 0600, only processes of the producer's
+ * user can take passwords from it.
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "shmpool.h"
+
+#define SLOT(pool, pos) \
+    ((pool)->slots + ((pos) % (pool)->hdr->slots) * (pool)->hdr->slot_stride)
+#define SLOT_SEQ(slot)  ((uint64_t *) (slot))
+#define SLOT_DATA(slot) ((char *) (slot) + sizeof(uint64_t))
+
+static int
+map_pool(struct shmpool *pool, int fd, size_t len)
+{
+    void *map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return 0;
+    }
+    pool->hdr     = map;
+    pool->slots   = (unsigned char *) map + sizeof(struct shmpool_header);
+    pool->map_len = len;
+
+    return 1;
+}
+
+/**
+ * Returns 1 if the existing segment name is a pool whose producer has died
+ * and can be replaced, 0 if it may still be in use or is not a pgen pool
+ */
+static int
+is_stale(const char *name)
+{
+    struct shmpool_header   hdr;
+    int                     fd;
+    int                     ret = 0;
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) == -1)
+        return 0;
+    if (read(fd, &hdr, sizeof hdr) == (ssize_t) sizeof hdr &&
+        !memcmp(hdr.magic, SHMPOOL_MAGIC, sizeof hdr.magic) && hdr.producer &&
+        kill((pid_t) hdr.producer, 0) == -1 && errno == ESRCH)
+    {
+        ret = 1;
+    }
+    close(fd);
+
+    return ret;
+}
+
+/**
+ * Creates the pool segment name with the given number of slots, each holding
+ * a password of up to slot_size bytes including terminator. A segment of
+ * the same name is only replaced if its producer is no longer running.
+ * Returns 1 on success, on failure an error is printed to stderr and 0 is
+ * returned.
+ */
+int
+shmpool_create(struct shmpool *pool, const char *name, size_t slots,
+               size_t slot_size)
+{
+    struct stat st;
+    size_t      stride;
+    size_t      len;
+    int         fd;
+
+    stride = (sizeof(uint64_t) + slot_size + SHMPOOL_ALIGN - 1)
+             / SHMPOOL_ALIGN * SHMPOOL_ALIGN;
+    if (slots < 1 || stride < slot_size || slots > (SIZE_MAX - sizeof(struct
+        shmpool_header)) / stride)
+    {
+        fprintf(stderr, "E: invalid pool size\n");
+        return 0;
+    }
+    len = sizeof(struct shmpool_header) + slots * stride;
+
+    if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) == -1 &&
+        errno == EEXIST && is_stale(name))
+    {
+        shm_unlink(name);
+        fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    if (fd == -1) {
+        if (errno == EEXIST)
+            fprintf(stderr, "E: %s: pool exists, another producer may be "
+                    "running\n", name);
+        else
+            perror("shm_open");
+        return 0;
+    }
+    if (fstat(fd, &st) == -1 || ftruncate(fd, len) == -1) {
+        perror("ftruncate");
+        close(fd);
+        shm_unlink(name);
+        return 0;
+    }
+    pool->dev = st.st_dev;
+    pool->ino = st.st_ino;
+    if (!map_pool(pool, fd, len)) {
+        close(fd);
+        shm_unlink(name);
+        return 0;
+    }
+    close(fd);
+
+    pool->hdr->slots       = slots;
+    pool->hdr->slot_size   = slot_size;
+    pool->hdr->slot_stride = stride;
+    pool->hdr->producer    = (uint64_t) getpid();
+    pool->hdr->head        = 0;
+    pool->hdr->tail        = 0;
+    for (size_t i = 0; i < slots; ++i)
+        *SLOT_SEQ(SLOT(pool, i)) = i;
+
+    // consumers check the magic last, publish it after everything else
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(pool->hdr->magic, SHMPOOL_MAGIC, sizeof pool->hdr->magic);
+
+    return 1;
+}
+
+/**
+ * Maps an existing pool segment for taking passwords. Only a segment owned
+ * by the effective user without group or other access is accepted. Returns
+ * 1 on success, on failure an error is printed to stderr and 0 is returned.
+ */
+int
+shmpool_open(struct shmpool *pool, const char *name)
+{
+    struct stat st;
+    int         fd;
+
+    if ((fd = shm_open(name, O_RDWR, 0)) == -1) {
+        perror("shm_open");
+        return 0;
+    }
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        close(fd);
+        return 0;
+    }
+    // any user may have created the name first, trust only a private segment
+    if (st.st_uid != geteuid() || (st.st_mode & 077)) {
+        fprintf(stderr, "E: %s: pool is not owned by this user or is not "
+                "private\n", name);
+        close(fd);
+        return 0;
+    }
+    if ((size_t) st.st_size < sizeof(struct shmpool_header)) {
+        fprintf(stderr, "E: %s: not a pgen pool\n", name);
+        close(fd);
+        return 0;
+    }
+    if (!map_pool(pool, fd, st.st_size)) {
+        close(fd);
+        return 0;
+    }
+    close(fd);
+
+    if (memcmp(pool->hdr->magic, SHMPOOL_MAGIC, sizeof pool->hdr->magic) ||
+        pool->hdr->slots == 0 || pool->hdr->slot_size == 0 ||
+        pool->hdr->slot_stride <
+            sizeof(uint64_t) + pool->hdr->slot_size ||
+        (pool->map_len - sizeof(struct shmpool_header)) / pool->hdr->slot_stride
+            < pool->hdr->slots)
+    {
+        fprintf(stderr, "E: %s: not a pgen pool\n", name);
+        shmpool_close(pool);
+        return 0;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return 1;
+}
+
+void
+shmpool_close(struct shmpool *pool)
+{
+    if (pool->hdr)
+        munmap(pool->hdr, pool->map_len);
+    memset(pool, 0, sizeof(struct shmpool));
+}
+
+/**
+ * Removes the pool segment name if it is still the one pool created, a
+ * segment since created under the same name by another producer is left
+ * alone. Passwords still in it are wiped once the last process unmaps it.
+ */
+int
+shmpool_unlink(const struct shmpool *pool, const char *name)
+{
+    struct stat st;
+    int         fd;
+
+    if ((fd = shm_open(name, O_RDONLY, 0)) == -1)
+        return 0;
+    if (fstat(fd, &st) == -1 || st.st_dev != pool->dev ||
+        st.st_ino != pool->ino)
+    {
+        close(fd);
+        return 0;
+    }
+    close(fd);
+
+    if (shm_unlink(name) == -1) {
+        perror("shm_unlink");
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Returns the number of positions produced but not yet claimed
+ */
+size_t
+shmpool_fill(const struct shmpool *pool)
+{
+    uint64_t tail = __atomic_load_n(&pool->hdr->tail, __ATOMIC_RELAXED);
+
+    return pool->hdr->head - tail;
+}
+
+/**
+ * Returns the password buffer of the next slot for the producer to fill, or
+ * NULL if that slot is still full or being read by a consumer. The slot is
+ * made available to consumers by shmpool_publish().
+ */
+char *
+shmpool_slot(struct shmpool *pool)
+{
+    uint64_t        pos  = pool->hdr->head;
+    unsigned char   *slot = SLOT(pool, pos);
+
+    if (__atomic_load_n(SLOT_SEQ(slot), __ATOMIC_ACQUIRE) != pos)
+        return NULL;
+
+    return SLOT_DATA(slot);
+}
+
+void
+shmpool_publish(struct shmpool *pool)
+{
+    uint64_t        pos  = pool->hdr->head;
+    unsigned char   *slot = SLOT(pool, pos);
+
+    __atomic_store_n(SLOT_SEQ(slot), pos + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&pool->hdr->head, pos + 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Takes one password from the pool into out, which must hold slot_size
+ * bytes. out is always null terminated. Returns 1 on success and 0 if the
+ * pool is empty.
+ */
+int
+shmpool_take(struct shmpool *pool, char *out)
+{
+    uint64_t pos = __atomic_load_n(&pool->hdr->tail, __ATOMIC_RELAXED);
+
+    for (;;) {
+        unsigned char   *slot = SLOT(pool, pos);
+        uint64_t        seq   = __atomic_load_n(SLOT_SEQ(slot), __ATOMIC_ACQUIRE);
+        int64_t         diff  = (int64_t) (seq - (pos + 1));
+
+        if (diff == 0) {
+            // on failure pos is reloaded with the current tail
+            if (__atomic_compare_exchange_n(&pool->hdr->tail, &pos, pos + 1, 0,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&pool->hdr->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    {
+        unsigned char *slot = SLOT(pool, pos);
+
+        memcpy(out, SLOT_DATA(slot), pool->hdr->slot_size);
+        out[pool->hdr->slot_size - 1] = '\0';
+        memset(SLOT_DATA(slot), 0, pool->hdr->slot_size);
+        __atomic_store_n(SLOT_SEQ(slot), pos + pool->hdr->slots, __ATOMIC_RELEASE);
+    }
+
+    return 1;
+}
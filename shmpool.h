@@ -0,0 +1,49 @@
+#ifndef SHMPOOL_H
+#define SHMPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SHMPOOL_MAGIC   "PGENPOOL"
+#define SHMPOOL_ALIGN   64          // slots and indices sit on own cache lines
+
+/*
+ * Shared memory layout: this header followed by slots of slot_stride bytes.
+ * Each slot starts with a 64 bit sequence number followed by the password.
+ * A slot at position pos (mod slots) holds seq == pos while empty and
+ * seq == pos + 1 once filled. The single producer advances head, consumers
+ * claim positions by advancing tail with compare and swap.
+ */
+struct shmpool_header {
+    char        magic[8];
+    uint64_t    slots;
+    uint64_t    slot_size;          // password bytes including terminator
+    uint64_t    slot_stride;
+    uint64_t    producer;           // pid of the producing process
+    char        pad0[SHMPOOL_ALIGN - 40];
+    uint64_t    head;
+    char        pad1[SHMPOOL_ALIGN - 8];
+    uint64_t    tail;
+    char        pad2[SHMPOOL_ALIGN - 8];
+};
+
+struct shmpool {
+    struct shmpool_header   *hdr;
+    unsigned char           *slots;
+    size_t                  map_len;
+    dev_t                   dev;    // identity of a segment we created
+    ino_t                   ino;
+};
+
+int shmpool_create(struct shmpool *pool, const char *name, size_t slots,
+                   size_t slot_size);
+int shmpool_open(struct shmpool *pool, const char *name);
+void shmpool_close(struct shmpool *pool);
+int shmpool_unlink(const struct shmpool *pool, const char *name);
+size_t shmpool_fill(const struct shmpool *pool);
+char *shmpool_slot(struct shmpool *pool);
+void shmpool_publish(struct shmpool *pool);
+int shmpool_take(struct shmpool *pool, char *out);
+
+#endif  /* SHMPOOL_H */
@@ -0,0 +1,94 @@
+/*****************************************************************************
+ * Batch slicing for pgen
+ *
+ * Hashing, insecure generation and keyspace enumeration all split a batch of
+ * independent records into one contiguous slice per thread, so the output
+ * order does not depend on the thread count.
+ ****************************************************************************/
+
+#define _XOPEN_SOURCE 500
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+
+#include "slice.h"
+
+struct slice_job {
+    slice_fn    fn;
+    void        *ctx;
+    long        t;
+    size_t      begin;
+    size_t      end;
+    int         ok;
+};
+
+static void *
+slice_worker(void *arg)
+{
+    struct slice_job *job = arg;
+
+    job->ok = job->fn(job->ctx, job->t, job->begin, job->end);
+
+    return NULL;
+}
+
+/**
+ * Runs fn over n items split into contiguous slices for up to nthreads
+ * threads, thread t taking the t-th slice. The calling thread takes the
+ * first slice itself. Returns 1 if every slice succeeded, on failure an
+ * error is printed to stderr and 0 is returned.
+ */
+int
+run_slices(size_t n, long nthreads, slice_fn fn, void *ctx)
+{
+    struct slice_job    *jobs;
+    pthread_t           *tids;
+    size_t              per_thread;
+    long                started = 0;
+    int                 ret     = 1;
+
+    if (nthreads < 1)
+        nthreads = 1;
+    if ((size_t) nthreads > n)
+        nthreads = n ? (long) n : 1;
+    per_thread = (n + nthreads - 1) / nthreads;
+
+    jobs = malloc(nthreads * sizeof(struct slice_job));
+    tids = malloc(nthreads * sizeof(pthread_t));
+    if (!jobs || !tids) {
+        fprintf(stderr, "E: failed to allocate memory (malloc)\n");
+        free(jobs);
+        free(tids);
+        return 0;
+    }
+
+    for (long t = 0; t < nthreads; ++t) {
+        jobs[t].fn    = fn;
+        jobs[t].ctx   = ctx;
+        jobs[t].t     = t;
+        jobs[t].begin = t * per_thread < n ? t * per_thread : n;
+        jobs[t].end   = jobs[t].begin + per_thread < n
+                        ? jobs[t].begin + per_thread : n;
+        jobs[t].ok    = 0;
+    }
+
+    for (long t = 1; t < nthreads; ++t) {
+        if (pthread_create(&tids[t], NULL, slice_worker, &jobs[t])) {
+            fprintf(stderr, "E: failed to create worker thread\n");
+            ret = 0;
+            break;
+        }
+        ++started;
+    }
+    if (ret)
+        slice_worker(&jobs[0]);
+    for (long t = 1; t <= started; ++t)
+        pthread_join(tids[t], NULL);
+    for (long t = 0; ret && t < nthreads; ++t)
+        ret = jobs[t].ok;
+
+    free(jobs);
+    free(tids);
+    return ret;
+}
@@ -0,0 +1,14 @@
+#ifndef SLICE_H
+#define SLICE_H
+
+#include <stddef.h>
+
+/*
+ * Work on the items [begin, end) of a batch as thread t. Returns 1 on
+ * success, on failure an error is printed to stderr and 0 is returned.
+ */
+typedef int (*slice_fn)(void *ctx, long t, size_t begin, size_t end);
+
+int run_slices(size_t n, long nthreads, slice_fn fn, void *ctx);
+
+#endif  /* SLICE_H */